@@ -0,0 +1,213 @@
+/*
+Mondee Lu, cs107, aging.c
+This program ages the explicit list heap allocator in explicit.c. It replays a long, seeded stream of mymalloc, myfree, and myrealloc
+calls whose size distribution and object lifetimes change from phase to phase, and periodically samples the shape of the heap, so the
+drift in fragmentation over hundreds of millions of operations can be compared between allocator configurations.
+
+WORKLOAD: Live objects sit in two windows of slots: a short-lived window that is touched by most operations and a long-lived window
+that is touched rarely, so its objects survive across many phases. Each operation picks a slot in one of the windows. An empty slot is
+filled by a new allocation, and an occupied one is either reallocated to a new size or freed. Every phase draws a size distribution
+(from a handful of shapes, small to large), the share of operations that go to the long-lived window, and the realloc rate. A phase
+change therefore leaves behind long-lived objects sized for the previous phase, which is what fragments a heap over days of churn.
+
+CONFIGURATIONS: Every configuration replays the same stream on a fresh heap:
+    first-fit   - mymalloc and myfree on one shard
+    hinted      - mymalloc_flags, with long-lived objects hinted MYMALLOC_LONG_LIVED and placed at the high end, and the rest hinted
+                  MYMALLOC_SHORT_LIVED and placed in the lowest free block that fits
+    quick       - mymalloc_small and myfree_small, so small blocks are cached on the quick lists
+    sharded     - mymalloc and myfree on four shards
+    side-links  - mymalloc and myfree with the free list links kept in a side table
+    adaptive    - mymalloc and myfree with each shard switching between first and best fit at run time
+
+OUTPUT: One CSV row per sample: configuration, operation count, phase, utilization (live requested bytes over bytes in use), bytes in
+use, free list length, largest free payload, external fragmentation (1 - largest free payload / free bytes), failed requests so far,
+and the number of shards placing with best fit, which shows when the adaptive configuration switches policy. To plot the drift of one column per configuration with gnuplot:
+
+    ./aging > aging.csv
+    gnuplot -e "set datafile separator ','; set key autotitle columnhead; plot for [c in 'first-fit hinted quick sharded side-links adaptive'] \
+        'aging.csv' using (strcol(1) eq c ? \$2 : NaN):4 with lines title c"
+
+USAGE: ./aging [ops] [heap_mb] [seed]
+*/
+#include "allocator.h"
+#include "explicit.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_OPS 200000000
+#define DEFAULT_HEAP_MB 64
+#define NUM_SAMPLES 200 // rows per configuration
+#define NUM_PHASES 40 // phase changes per run
+#define SHORT_SLOTS 2048
+#define LONG_SLOTS 8192
+
+// one live object, size is 0 when the slot is empty
+typedef struct Slot {
+    void *ptr;
+    size_t size;
+} Slot;
+
+// size range and lifetime mix of one phase
+typedef struct Phase {
+    size_t min_size;
+    size_t max_size;
+    unsigned int long_lived_pct; // share of operations on the long-lived window
+    unsigned int realloc_pct; // share of operations on an occupied slot that realloc instead of free
+} Phase;
+
+typedef struct Config {
+    const char *name;
+    MyHeapOptions opts;
+    bool hinted;
+    bool quick;
+} Config;
+
+static const Phase phase_shapes[] = {
+    {8, 128, 5, 10},
+    {64, 2048, 10, 20},
+    {8, 8192, 2, 5},
+    {1024, 16384, 20, 30},
+    {16, 512, 1, 50},
+};
+
+static const Config configs[] = {
+    {"first-fit", {0}, false, false},
+    {"hinted", {0}, true, false},
+    {"quick", {0}, false, true},
+    {"sharded", {.num_shards = 4}, false, false},
+    {"side-links", {.side_link_slots = 1 << 16}, false, false},
+    {"adaptive", {.adaptive = true}, false, false},
+};
+
+static Slot slots[SHORT_SLOTS + LONG_SLOTS];
+
+/*
+Function: random_size
+Input: Pointer to a Phase and pointer to the seed
+Return Value: size_t number
+=====================================================
+Returns a size between the phase's bounds, log-uniformly distributed so small sizes are as likely per doubling as large ones.
+*/
+size_t random_size(const Phase *phase, unsigned int *seed) {
+    size_t size = phase->min_size;
+    while (size * 2 <= phase->max_size && rand_r(seed) % 2 == 0) {
+        size *= 2;
+    }
+    return size + rand_r(seed) % size;
+}
+
+/*
+Function: release
+Input: Pointer to a Config and pointer to a Slot
+Return Value: None
+=====================================================
+Frees the slot's object the way the configuration frees, and empties the slot.
+*/
+void release(const Config *config, Slot *slot) {
+    if (config->quick) {
+        myfree_small(slot->ptr);
+    } else {
+        myfree(slot->ptr);
+    }
+    slot->ptr = NULL;
+    slot->size = 0;
+}
+
+/*
+Function: run_config
+Input: Pointer to a Config, heap segment and size, size_t number of ops, and seed
+Return Value: Boolean
+=====================================================
+Replays the workload for the given seed on a fresh heap with the configuration's options and prints NUM_SAMPLES rows along the
+way. Every live object is freed at the end, after which the heap must validate. Returns false if init or validation fails.
+*/
+bool run_config(const Config *config, void *heap, size_t heap_size, size_t ops, unsigned int seed) {
+    if (!myinit_opts(heap, heap_size, &config->opts)) {
+        return false;
+    }
+    size_t live_bytes = 0;
+    size_t failures = 0;
+    size_t sample_every = ops / NUM_SAMPLES > 0 ? ops / NUM_SAMPLES : 1;
+    size_t phase_every = ops / NUM_PHASES > 0 ? ops / NUM_PHASES : 1;
+    const Phase *phase = &phase_shapes[0];
+    size_t phase_index = 0;
+
+    for (size_t op = 0; op < ops; op++) {
+        if (op % phase_every == 0) {
+            phase_index = op / phase_every;
+            phase = &phase_shapes[rand_r(&seed) % (sizeof(phase_shapes) / sizeof(phase_shapes[0]))];
+        }
+        bool long_lived = (unsigned int)(rand_r(&seed) % 100) < phase->long_lived_pct;
+        Slot *slot = long_lived ? &slots[SHORT_SLOTS + rand_r(&seed) % LONG_SLOTS] : &slots[rand_r(&seed) % SHORT_SLOTS];
+
+        if (slot->ptr == NULL) {
+            size_t size = random_size(phase, &seed);
+            if (config->hinted) {
+                slot->ptr = mymalloc_flags(size, long_lived ? MYMALLOC_LONG_LIVED : MYMALLOC_SHORT_LIVED);
+            } else if (config->quick) {
+                slot->ptr = mymalloc_small(size);
+            } else {
+                slot->ptr = mymalloc(size);
+            }
+            if (slot->ptr != NULL) {
+                slot->size = size;
+                live_bytes += size;
+            } else {
+                failures++;
+            }
+        } else if ((unsigned int)(rand_r(&seed) % 100) < phase->realloc_pct) {
+            size_t size = random_size(phase, &seed);
+            void *ptr = myrealloc(slot->ptr, size);
+            if (ptr != NULL) {
+                live_bytes += size - slot->size;
+                slot->ptr = ptr;
+                slot->size = size;
+            } else {
+                failures++;
+            }
+        } else {
+            live_bytes -= slot->size;
+            release(config, slot);
+        }
+
+        if ((op + 1) % sample_every == 0) {
+            MyHeapStats stats;
+            myheap_stats(&stats);
+            printf("%s,%zu,%zu,%.4f,%zu,%zu,%zu,%.4f,%zu,%zu\n", config->name, op + 1, phase_index,
+                   stats.usage > 0 ? (double)live_bytes / stats.usage : 0.0, stats.usage, stats.free_blocks,
+                   stats.largest_free_payload,
+                   stats.free_bytes > 0 ? 1.0 - (double)stats.largest_free_payload / stats.free_bytes : 0.0, failures,
+                   stats.best_fit_shards);
+        }
+    }
+
+    for (size_t i = 0; i < SHORT_SLOTS + LONG_SLOTS; i++) {
+        if (slots[i].ptr != NULL) {
+            release(config, &slots[i]);
+        }
+    }
+    myheap_quick_flush();
+    return validate_heap_full();
+}
+
+int main(int argc, char *argv[]) {
+    size_t ops = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_OPS;
+    size_t heap_size = (size_t)(argc > 2 ? atoi(argv[2]) : DEFAULT_HEAP_MB) << 20;
+    unsigned int seed = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+    void *heap = malloc(heap_size);
+    if (heap == NULL || ops == 0) {
+        fprintf(stderr, "usage: %s [ops] [heap_mb] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    printf("config,op,phase,utilization,usage,free_blocks,largest_free,fragmentation,failures,best_fit_shards\n");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        if (!run_config(&configs[i], heap, heap_size, ops, seed)) {
+            fprintf(stderr, "%s: heap failed to initialize or validate\n", configs[i].name);
+            free(heap);
+            return 1;
+        }
+    }
+    free(heap);
+    return 0;
+}
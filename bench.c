@@ -0,0 +1,311 @@
+/*
+Mondee Lu, cs107, bench.c
+This program benchmarks the explicit list heap allocator in explicit.c. It runs a fixed set of workloads against a private heap
+segment and reports, for each one, the time and hardware events spent per malloc/free operation.
+
+COUNTERS: Around each workload the program opens one perf_event_open group counting instructions, cache misses, dTLB load misses,
+and branch misses for the calling thread in user space. The group is read once at the end, so all four events cover exactly the same
+interval, and each count is divided by the number of allocator calls the workload made. If the kernel refuses the counters (for example
+because of perf_event_paranoid, or inside a container without a PMU), or has to multiplex them with other events so that they ran
+for only part of the workload, the events are reported as n/a and only the timings are kept.
+
+WORKLOADS: Each workload is seeded, so two runs (or two builds of explicit.c) replay the same sequence of requests:
+    random   - mallocs and frees of 1..512 bytes mixed at random over a window of live blocks, the find_fit/coalesce_right path
+    small    - the same mix restricted to 16..128 bytes through mymalloc_small/myfree_small, the quick list path
+    realloc  - blocks grown with myrealloc in small steps and then freed, the resize_in_place path
+    large    - mallocs and frees of 4KB..64KB, which split and merge large free blocks
+
+USAGE: ./bench [heap_mb] [ops]
+*/
+#define _GNU_SOURCE
+#include "allocator.h"
+#include "explicit.h"
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_EVENTS 4
+#define MAX_LIVE 4096
+#define DEFAULT_HEAP_MB 64
+#define DEFAULT_OPS 1000000
+
+static const char *event_names[NUM_EVENTS] = {"instr", "cache-miss", "dtlb-miss", "br-miss"};
+
+// one group of counters, fds[0] is the group leader and -1 means the counter could not be opened
+typedef struct Counters {
+    int fds[NUM_EVENTS];
+} Counters;
+
+// values read from a group, in the order of event_names
+typedef struct CounterValues {
+    bool valid;
+    unsigned long long counts[NUM_EVENTS];
+} CounterValues;
+
+typedef size_t (*workload)(void **live, size_t ops, unsigned int seed);
+
+/* ------------------
+ * COUNTERS
+ * ------------------
+ */
+
+/*
+Function: open_counter
+Input: Integers type, config and group_fd
+Return Value: Integer
+=====================================================
+Opens one disabled user-space counter for the calling thread in the given group (or as a new leader when group_fd is -1)
+and returns its file descriptor, or -1 if the kernel refuses it.
+*/
+int open_counter(unsigned int type, unsigned long long config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd == -1; // members follow the leader
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/*
+Function: open_counters
+Input: Pointer to a Counters struct
+Return Value: Boolean
+=====================================================
+Opens the instruction, cache miss, dTLB miss and branch miss counters as one group. Returns false, with every fd closed,
+unless all of them could be opened.
+*/
+bool open_counters(Counters *counters) {
+    static const unsigned long long dtlb_read_miss = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    counters->fds[0] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1);
+    counters->fds[1] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, counters->fds[0]);
+    counters->fds[2] = open_counter(PERF_TYPE_HW_CACHE, dtlb_read_miss, counters->fds[0]);
+    counters->fds[3] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, counters->fds[0]);
+
+    bool opened = true;
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        opened = opened && counters->fds[i] >= 0;
+    }
+    if (!opened) {
+        for (int i = 0; i < NUM_EVENTS; i++) {
+            if (counters->fds[i] >= 0) {
+                close(counters->fds[i]);
+            }
+            counters->fds[i] = -1;
+        }
+    }
+    return opened;
+}
+
+/*
+Function: read_counters
+Input: Pointer to a Counters struct and pointer to a CounterValues struct
+Return Value: None
+=====================================================
+Reads the whole group in one call and closes it. values->valid is false if the group was never opened, or if the kernel had to
+multiplex it, which shows as the group running for less time than it was enabled, so the counts cover less than the full interval.
+*/
+void read_counters(Counters *counters, CounterValues *values) {
+    values->valid = false;
+    if (counters->fds[0] < 0) {
+        return;
+    }
+    ioctl(counters->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    unsigned long long buf[3 + NUM_EVENTS]; // nr, time enabled, time running, then one value per event
+    if (read(counters->fds[0], buf, sizeof(buf)) == (ssize_t)sizeof(buf) && buf[0] == NUM_EVENTS && buf[2] == buf[1]) {
+        memcpy(values->counts, buf + 3, sizeof(values->counts));
+        values->valid = true;
+    }
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        close(counters->fds[i]);
+    }
+}
+
+/* ------------------
+ * WORKLOADS
+ * ------------------
+ */
+
+/*
+Function: run_random
+Input: Array of live pointers, size_t number of ops, and seed
+Return Value: size_t number
+=====================================================
+Mallocs or frees at a random slot of live, 1..512 bytes per request. Returns the number of allocator calls made.
+*/
+size_t run_random(void **live, size_t ops, unsigned int seed) {
+    size_t calls = 0;
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = rand_r(&seed) % MAX_LIVE;
+        if (live[slot] != NULL) {
+            myfree(live[slot]);
+            live[slot] = NULL;
+        } else {
+            live[slot] = mymalloc(1 + rand_r(&seed) % 512);
+        }
+        calls++;
+    }
+    return calls;
+}
+
+/*
+Function: run_small
+Input: Array of live pointers, size_t number of ops, and seed
+Return Value: size_t number
+=====================================================
+run_random restricted to quick list sizes, through mymalloc_small and myfree_small.
+*/
+size_t run_small(void **live, size_t ops, unsigned int seed) {
+    size_t calls = 0;
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = rand_r(&seed) % MAX_LIVE;
+        if (live[slot] != NULL) {
+            myfree_small(live[slot]);
+            live[slot] = NULL;
+        } else {
+            live[slot] = mymalloc_small(16 + rand_r(&seed) % (QUICK_MAX_PAYLOAD - 15));
+        }
+        calls++;
+    }
+    return calls;
+}
+
+/*
+Function: run_realloc
+Input: Array of live pointers, size_t number of ops, and seed
+Return Value: size_t number
+=====================================================
+Grows the block at a random slot of live by 8..64 bytes, freeing it once it passes 4KB.
+*/
+size_t run_realloc(void **live, size_t ops, unsigned int seed) {
+    static size_t sizes[MAX_LIVE];
+    size_t calls = 0;
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = rand_r(&seed) % MAX_LIVE;
+        if (sizes[slot] > 4096) {
+            myfree(live[slot]);
+            live[slot] = NULL;
+            sizes[slot] = 0;
+        } else {
+            size_t new_size = sizes[slot] + 8 + rand_r(&seed) % 57;
+            void *ptr = myrealloc(live[slot], new_size);
+            if (ptr != NULL) {
+                live[slot] = ptr;
+                sizes[slot] = new_size;
+            }
+        }
+        calls++;
+    }
+    memset(sizes, 0, sizeof(sizes));
+    return calls;
+}
+
+/*
+Function: run_large
+Input: Array of live pointers, size_t number of ops, and seed
+Return Value: size_t number
+=====================================================
+run_random with 4KB..64KB requests over a window of 256 slots.
+*/
+size_t run_large(void **live, size_t ops, unsigned int seed) {
+    size_t calls = 0;
+    for (size_t i = 0; i < ops; i++) {
+        size_t slot = rand_r(&seed) % 256;
+        if (live[slot] != NULL) {
+            myfree(live[slot]);
+            live[slot] = NULL;
+        } else {
+            live[slot] = mymalloc(4096 + rand_r(&seed) % (60 * 1024));
+        }
+        calls++;
+    }
+    return calls;
+}
+
+/* ------------------
+ * MAIN
+ * ------------------
+ */
+
+/*
+Function: run_workload
+Input: String name, workload function, heap segment and size, and size_t number of ops
+Return Value: Boolean
+=====================================================
+Reinitializes the heap, runs the workload inside one counter group, frees whatever it left live (outside the measured interval),
+and prints one row of results. Returns false if the heap could not be initialized.
+*/
+bool run_workload(const char *name, workload run, void *heap, size_t heap_size, size_t ops) {
+    static void *live[MAX_LIVE];
+    if (!myinit(heap, heap_size)) {
+        return false;
+    }
+
+    Counters counters;
+    CounterValues values;
+    struct timespec start, end;
+    bool counting = open_counters(&counters);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (counting) {
+        ioctl(counters.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counters.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    size_t calls = run(live, ops, 1);
+    read_counters(&counters, &values);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (size_t i = 0; i < MAX_LIVE; i++) {
+        myfree(live[i]);
+        live[i] = NULL;
+    }
+    myheap_quick_flush();
+
+    double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+    printf("%-10s %10zu %10.1f", name, calls, ns / calls);
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (values.valid) {
+            printf(" %10.3f", (double)values.counts[i] / calls);
+        } else {
+            printf(" %10s", "n/a");
+        }
+    }
+    printf("\n");
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    size_t heap_size = (size_t)(argc > 1 ? atoi(argv[1]) : DEFAULT_HEAP_MB) << 20;
+    size_t ops = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_OPS;
+    void *heap = malloc(heap_size);
+    if (heap == NULL || ops == 0) {
+        fprintf(stderr, "usage: %s [heap_mb] [ops]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-10s %10s %10s", "workload", "ops", "ns/op");
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        printf(" %10s", event_names[i]);
+    }
+    printf("\n");
+
+    bool ok = run_workload("random", run_random, heap, heap_size, ops) &&
+              run_workload("small", run_small, heap, heap_size, ops) &&
+              run_workload("realloc", run_realloc, heap, heap_size, ops) &&
+              run_workload("large", run_large, heap, heap_size, ops);
+    free(heap);
+    if (!ok) {
+        fprintf(stderr, "myinit failed for a %zu byte heap\n", heap_size);
+        return 1;
+    }
+    return 0;
+}
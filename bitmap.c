@@ -0,0 +1,315 @@
+/*
+Mondee Lu, cs107, bitmap.c
+This program implements a bitmap heap allocator for pools where every object is a multiple of one granule.
+
+MEMORY BLOCK DESIGN: The segment starts with a bitmap holding one bit per granule (1 for allocated, 0 for free), followed by the
+granules themselves, starting at a granule aligned address. Blocks have no header and free granules hold no links, so the only
+metadata is the bitmap, one bit per granule. Bits past the last granule in the final word are kept set so they are never handed out.
+
+FINDING A FIT: mymalloc finds the first run of enough free granules by alternating two scans: from the current position to the next
+clear bit (the start of a free run), then from there to the next set bit (its end). Within a word each scan is one count trailing
+zeros (tzcnt with -mbmi), and whole words that cannot contain the bit being looked for are skipped. With AVX2 the scans skip four
+words (256 granules) per test instruction. A search hint records the first word that may hold a free bit, so fully allocated words
+at the start of the pool are not rescanned by every request.
+
+FREEING: Freeing clears the bits of the block, which also merges it with any free neighbors, so there is no coalescing step. Since
+blocks have no header, the caller passes the size of the block back, as with a sized delete.
+
+THREAD SAFETY: One mutex serializes every call.
+*/
+#include "bitmap.h"
+#include "debug_break.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define ALIGNMENT 8
+#define WORD_BITS 64
+#define AVX_WORDS 4 // words tested per AVX2 instruction
+#define MAX_REQUEST_SIZE (1 << 30)
+
+static uint64_t *bitmap;
+static size_t num_words;
+static size_t num_granules;
+static unsigned char *granules_start;
+static size_t granule_size;
+static unsigned int granule_shift;
+static size_t search_hint; // every word before this one is fully allocated
+static size_t free_granules;
+static pthread_mutex_t bitmap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* ------------------
+ * BIT SCANS
+ * ------------------
+ */
+
+/*
+Function: next_free_bit
+Input: size_t bit index
+Return Value: size_t bit index
+=====================================================
+Returns the index of the first clear bit at or after the given one, or num_granules if there is none. Words with every bit set are
+skipped, four at a time with AVX2.
+*/
+size_t next_free_bit(size_t bit) {
+    size_t word = bit / WORD_BITS;
+    if (word >= num_words) {
+        return num_granules;
+    }
+    uint64_t free_bits = ~bitmap[word] & (~0ULL << (bit % WORD_BITS));
+    while (free_bits == 0) {
+        word++;
+#ifdef __AVX2__
+        const __m256i all_set = _mm256_set1_epi64x(-1);
+        while (word + AVX_WORDS <= num_words &&
+               _mm256_testc_si256(_mm256_loadu_si256((const __m256i *)(bitmap + word)), all_set)) {
+            word += AVX_WORDS;
+        }
+#endif
+        if (word >= num_words) {
+            return num_granules;
+        }
+        free_bits = ~bitmap[word];
+    }
+    size_t found = word * WORD_BITS + __builtin_ctzll(free_bits);
+    return found < num_granules ? found : num_granules;
+}
+
+/*
+Function: next_allocated_bit
+Input: size_t bit index and size_t limit
+Return Value: size_t bit index
+=====================================================
+Returns the index of the first set bit at or after the given one, or limit if there is none before it. Words with every bit clear
+are skipped, four at a time with AVX2.
+*/
+size_t next_allocated_bit(size_t bit, size_t limit) {
+    size_t word = bit / WORD_BITS;
+    size_t last_word = (limit + WORD_BITS - 1) / WORD_BITS;
+    if (last_word > num_words) {
+        last_word = num_words;
+    }
+    if (word >= last_word) {
+        return limit;
+    }
+    uint64_t set_bits = bitmap[word] & (~0ULL << (bit % WORD_BITS));
+    while (set_bits == 0) {
+        word++;
+#ifdef __AVX2__
+        while (word + AVX_WORDS <= last_word) {
+            __m256i words = _mm256_loadu_si256((const __m256i *)(bitmap + word));
+            if (!_mm256_testz_si256(words, words)) {
+                break;
+            }
+            word += AVX_WORDS;
+        }
+#endif
+        if (word >= last_word) {
+            return limit;
+        }
+        set_bits = bitmap[word];
+    }
+    size_t found = word * WORD_BITS + __builtin_ctzll(set_bits);
+    return found < limit ? found : limit;
+}
+
+/*
+Function: find_run
+Input: size_t number of granules
+Return Value: size_t bit index
+=====================================================
+Returns the first granule of the lowest run of at least the given number of free granules, or num_granules if there is none.
+Moves the search hint up to the first free bit it finds.
+*/
+size_t find_run(size_t count) {
+    size_t run_start = next_free_bit(search_hint * WORD_BITS);
+    search_hint = run_start / WORD_BITS;
+
+    while (run_start + count <= num_granules) {
+        size_t run_end = next_allocated_bit(run_start, run_start + count);
+        if (run_end - run_start >= count) {
+            return run_start;
+        }
+        run_start = next_free_bit(run_end);
+    }
+    return num_granules;
+}
+
+/*
+Function: set_bits
+Input: size_t first bit, size_t number of bits, and boolean
+Return Value: None
+=====================================================
+Sets (when allocated is true) or clears the given range of bits, a word at a time.
+*/
+void set_bits(size_t first, size_t count, bool allocated) {
+    while (count > 0) {
+        size_t word = first / WORD_BITS;
+        size_t offset = first % WORD_BITS;
+        size_t bits = WORD_BITS - offset < count ? WORD_BITS - offset : count;
+        uint64_t mask = (bits == WORD_BITS ? ~0ULL : ((1ULL << bits) - 1)) << offset;
+        if (allocated) {
+            bitmap[word] |= mask;
+        } else {
+            bitmap[word] &= ~mask;
+        }
+        first += bits;
+        count -= bits;
+    }
+}
+
+/* ------------------
+ * MAIN FUNCTIONS
+ * ------------------
+ */
+
+/*
+Function: mybitmap_init
+Input: Void pointer, size_t number, and size_t granule size
+Return Value: Boolean
+=======================================
+Places the bitmap at the start of the segment and as many granules as fit after it, all free. Returns false if the granule is not a
+power of two of at least ALIGNMENT bytes, or if the segment cannot hold a single granule.
+*/
+bool mybitmap_init(void *heap_start, size_t heap_size, size_t granule) {
+    if (granule < ALIGNMENT || (granule & (granule - 1)) != 0 || (uintptr_t)heap_start % ALIGNMENT != 0) {
+        return false;
+    }
+    uintptr_t start = (uintptr_t)heap_start;
+    uintptr_t end = start + heap_size;
+
+    // start from the count that ignores alignment and back off until the bitmap, padding, and granules all fit
+    size_t count = heap_size * 8 / (granule * 8 + 1);
+    while (count > 0) {
+        size_t words = (count + WORD_BITS - 1) / WORD_BITS;
+        uintptr_t first_granule = (start + words * sizeof(uint64_t) + granule - 1) & ~(uintptr_t)(granule - 1);
+        if (first_granule + count * granule <= end) {
+            break;
+        }
+        count--;
+    }
+    if (count == 0) {
+        return false;
+    }
+
+    bitmap = heap_start;
+    num_granules = count;
+    num_words = (count + WORD_BITS - 1) / WORD_BITS;
+    granules_start = (unsigned char *)((start + num_words * sizeof(uint64_t) + granule - 1) & ~(uintptr_t)(granule - 1));
+    granule_size = granule;
+    granule_shift = __builtin_ctzll(granule);
+    search_hint = 0;
+    free_granules = count;
+
+    memset(bitmap, 0, num_words * sizeof(uint64_t));
+    if (count % WORD_BITS != 0) {
+        bitmap[num_words - 1] = ~0ULL << (count % WORD_BITS); // padding bits past the last granule
+    }
+    return true;
+}
+
+/*
+Function: mybitmap_malloc
+Input: size_t number
+Return Value: Void pointer
+=======================================
+Rounds the request up to whole granules and allocates the lowest run of free granules that is long enough. Returns NULL for a
+request of 0 or more than MAX_REQUEST_SIZE bytes, or when no run is long enough.
+*/
+void *mybitmap_malloc(size_t requested_size) {
+    if (requested_size > MAX_REQUEST_SIZE || requested_size == 0) {
+        return NULL;
+    }
+    size_t count = (requested_size + granule_size - 1) >> granule_shift;
+
+    pthread_mutex_lock(&bitmap_lock);
+    size_t first = count <= free_granules ? find_run(count) : num_granules;
+    if (first == num_granules) {
+        pthread_mutex_unlock(&bitmap_lock);
+        return NULL;
+    }
+    set_bits(first, count, true);
+    free_granules -= count;
+    pthread_mutex_unlock(&bitmap_lock);
+    return granules_start + (first << granule_shift);
+}
+
+/*
+Function: mybitmap_free
+Input: Void pointer and size_t number
+Return Value: None
+=======================================
+Clears the bits of the block, which needs the size it was allocated with. Moves the search hint back if the block lies before it.
+*/
+void mybitmap_free(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return;
+    }
+    size_t first = ((unsigned char *)ptr - granules_start) >> granule_shift;
+    size_t count = (size + granule_size - 1) >> granule_shift;
+
+    pthread_mutex_lock(&bitmap_lock);
+    set_bits(first, count, false);
+    free_granules += count;
+    if (first / WORD_BITS < search_hint) {
+        search_hint = first / WORD_BITS;
+    }
+    pthread_mutex_unlock(&bitmap_lock);
+}
+
+/*
+Function: mybitmap_free_granules
+Input: None
+Return Value: size_t number
+=======================================
+Returns the number of granules that are not allocated.
+*/
+size_t mybitmap_free_granules(void) {
+    pthread_mutex_lock(&bitmap_lock);
+    size_t count = free_granules;
+    pthread_mutex_unlock(&bitmap_lock);
+    return count;
+}
+
+/* ------------------
+ * DEBUGGING
+ * ------------------
+ */
+
+/*
+Function: mybitmap_validate
+Input: None
+Return Value: Boolean
+=======================================
+Checks that the padding bits are set, that no word before the search hint has a clear bit, and that the number of clear bits
+matches free_granules. Prints the problem and hits a breakpoint on the first failure.
+*/
+bool mybitmap_validate(void) {
+    size_t clear_bits = 0;
+    for (size_t word = 0; word < num_words; word++) {
+        if (word < search_hint && bitmap[word] != ~0ULL) {
+            printf("word %zu has free granules but is before the search hint %zu\n", word, search_hint);
+            breakpoint();
+            return false;
+        }
+        clear_bits += WORD_BITS - __builtin_popcountll(bitmap[word]);
+    }
+    if (num_granules % WORD_BITS != 0) {
+        uint64_t padding = ~0ULL << (num_granules % WORD_BITS);
+        if ((bitmap[num_words - 1] & padding) != padding) {
+            printf("padding bits past granule %zu are clear\n", num_granules);
+            breakpoint();
+            return false;
+        }
+    }
+    if (clear_bits != free_granules) {
+        printf("bitmap has %zu free granules but %zu are counted\n", clear_bits, free_granules);
+        breakpoint();
+        return false;
+    }
+    return true;
+}
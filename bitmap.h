@@ -0,0 +1,23 @@
+/*
+Mondee Lu, cs107, bitmap.h
+This header declares the bitmap heap allocator implemented in bitmap.c, an alternative to the explicit list allocator for pools whose
+objects are all multiples of one granule. Blocks carry no header, so the size of a block must be passed back when it is freed.
+*/
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// takes over the segment, with every block a whole number of granules, granule must be a power of two and at least 8
+bool mybitmap_init(void *heap_start, size_t heap_size, size_t granule);
+// returns a granule aligned block of at least requested_size bytes, or NULL if no run of free granules is long enough
+void *mybitmap_malloc(size_t requested_size);
+// frees a block returned by mybitmap_malloc, size must be the size it was requested with
+void mybitmap_free(void *ptr, size_t size);
+// number of granules not allocated
+size_t mybitmap_free_granules(void);
+// checks that the free granule count and the padding bits agree with the bitmap
+bool mybitmap_validate(void);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+Mondee Lu, cs107, cachescratch.c
+This program measures false sharing in the objects handed out by the explicit list heap allocator in explicit.c, in the style of the
+cache-scratch benchmark from the Hoard allocator's test suite. Objects written by different threads that share a cache line make the
+line bounce between cores on every write, so a workload whose threads never touch each other's objects can still run slower with more
+threads.
+
+WORKLOAD: The main thread allocates one small object per worker, back to back, and hands one to each worker. Each worker frees the
+object it was given, which is passive false sharing: the freed block may be handed to the worker again, still sharing a line with the
+objects of its neighbors. The worker then repeatedly allocates an object of the same size, writes every byte of it many times, and
+frees it. An allocator that keeps threads' objects on separate lines runs this in the same time with one or many workers.
+
+CONFIGURATIONS: Every configuration runs the same workload on a fresh heap:
+    mymalloc   - mymalloc and myfree
+    cacheline  - mymalloc_cacheline and myfree
+    small      - mymalloc_small and myfree_small
+
+OUTPUT: One row per configuration: the wall time of the run, and how many workers' first objects of their own shared a cache line
+with another worker's. Every worker keeps its first object live until all of them have allocated one, so those objects are live at
+the same time, and the second column shows the placement even on a machine with a single core, where the time cannot.
+
+USAGE: ./cachescratch [threads] [iterations] [repetitions] [object_size]
+*/
+#include "allocator.h"
+#include "explicit.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_THREADS 64
+#define DEFAULT_THREADS 4
+#define DEFAULT_ITERATIONS 1000
+#define DEFAULT_REPETITIONS 10000
+#define DEFAULT_OBJECT_SIZE 8
+#define HEAP_SIZE (16 << 20)
+#define LINE_SIZE 64
+
+typedef struct Config {
+    const char *name;
+    void *(*alloc)(size_t);
+    void (*release)(void *);
+} Config;
+
+// one worker's parameters, and the first object it allocated for itself
+typedef struct Worker {
+    const Config *config;
+    char *given;
+    char *first;
+    size_t iterations;
+    size_t repetitions;
+    size_t object_size;
+} Worker;
+
+/*
+Function: alloc_small
+Input: size_t number
+Return Value: Void pointer
+=====================================================
+Wraps the static inline mymalloc_small so it can be called through a Config.
+*/
+void *alloc_small(size_t size) {
+    return mymalloc_small(size);
+}
+
+/*
+Function: release_small
+Input: Void pointer
+Return Value: None
+=====================================================
+Wraps the static inline myfree_small so it can be called through a Config.
+*/
+void release_small(void *ptr) {
+    myfree_small(ptr);
+}
+
+static pthread_barrier_t first_allocated; // every worker has its first object live
+
+static const Config configs[] = {
+    {"mymalloc", mymalloc, myfree},
+    {"cacheline", mymalloc_cacheline, myfree},
+    {"small", alloc_small, release_small},
+};
+
+/*
+Function: run_worker
+Input: Void pointer to a Worker
+Return Value: Void pointer
+=====================================================
+Frees the object the main thread handed over, then allocates, scratches, and frees its own objects. The first of those is recorded,
+and held until every worker has its own, so the main thread can check which lines were shared.
+*/
+void *run_worker(void *arg) {
+    Worker *worker = arg;
+    worker->config->release(worker->given);
+
+    for (size_t i = 0; i < worker->iterations; i++) {
+        volatile char *object = worker->config->alloc(worker->object_size);
+        if (i == 0) {
+            worker->first = (char *)object;
+            pthread_barrier_wait(&first_allocated);
+        }
+        if (object == NULL) {
+            continue;
+        }
+        for (size_t r = 0; r < worker->repetitions; r++) {
+            for (size_t b = 0; b < worker->object_size; b++) {
+                object[b]++;
+            }
+        }
+        worker->config->release((void *)object);
+    }
+    return NULL;
+}
+
+/*
+Function: shares_line
+Input: Two char pointers and size_t number
+Return Value: Boolean
+=====================================================
+Returns true if objects of the given size at the two addresses have a cache line in common.
+*/
+bool shares_line(const char *a, const char *b, size_t object_size) {
+    uintptr_t a_first = (uintptr_t)a / LINE_SIZE, a_last = ((uintptr_t)a + object_size - 1) / LINE_SIZE;
+    uintptr_t b_first = (uintptr_t)b / LINE_SIZE, b_last = ((uintptr_t)b + object_size - 1) / LINE_SIZE;
+    return a_first <= b_last && b_first <= a_last;
+}
+
+/*
+Function: run_config
+Input: Pointer to a Config, heap segment, and the workload parameters
+Return Value: Boolean
+=====================================================
+Runs the workload for one configuration on a fresh heap and prints its row. Returns false if init fails, a thread cannot be
+started, or the heap does not validate afterwards.
+*/
+bool run_config(const Config *config, void *heap, size_t threads, size_t iterations, size_t repetitions, size_t object_size) {
+    static Worker workers[MAX_THREADS];
+    static pthread_t tids[MAX_THREADS];
+    if (!myinit(heap, HEAP_SIZE)) {
+        return false;
+    }
+    pthread_barrier_init(&first_allocated, NULL, threads);
+
+    for (size_t i = 0; i < threads; i++) { // back to back, as a single-threaded producer would
+        workers[i] = (Worker){config, config->alloc(object_size), NULL, iterations, repetitions, object_size};
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < threads; i++) {
+        if (pthread_create(&tids[i], NULL, run_worker, &workers[i]) != 0) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_barrier_destroy(&first_allocated);
+
+    size_t shared = 0;
+    for (size_t i = 0; i < threads; i++) {
+        for (size_t j = 0; j < threads; j++) {
+            if (i != j && workers[i].first != NULL && workers[j].first != NULL &&
+                shares_line(workers[i].first, workers[j].first, object_size)) {
+                shared++;
+                break;
+            }
+        }
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-10s %10.3f %10zu\n", config->name, seconds, shared);
+    myheap_quick_flush();
+    return validate_heap_full();
+}
+
+int main(int argc, char *argv[]) {
+    size_t threads = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_THREADS;
+    size_t iterations = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_ITERATIONS;
+    size_t repetitions = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_REPETITIONS;
+    size_t object_size = argc > 4 ? strtoul(argv[4], NULL, 10) : DEFAULT_OBJECT_SIZE;
+    void *heap = malloc(HEAP_SIZE);
+    if (heap == NULL || threads == 0 || threads > MAX_THREADS || object_size == 0 || object_size > QUICK_MAX_PAYLOAD) {
+        fprintf(stderr, "usage: %s [threads <= %d] [iterations] [repetitions] [object_size <= %d]\n", argv[0], MAX_THREADS,
+                QUICK_MAX_PAYLOAD);
+        return 1;
+    }
+
+    printf("%-10s %10s %10s\n", "config", "seconds", "shared");
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+        if (!run_config(&configs[i], heap, threads, iterations, repetitions, object_size)) {
+            fprintf(stderr, "%s: heap failed to initialize, run, or validate\n", configs[i].name);
+            free(heap);
+            return 1;
+        }
+    }
+    free(heap);
+    return 0;
+}
@@ -3,19 +3,156 @@ Mondee Lu, cs107, explicit.c
 This program impelments an explicit list heap allocator. 
 
 INITIALIZATION: The heap allocator is initialized with a pointer to the start of the heap segment and the size of the heap segment. 
+myinit_opts additionally takes a MyHeapOptions struct (declared in explicit.h) for the optional features described below.
 
 MEMORY BLOCK DESIGN: Each block of memory contains an 8-byte header with information about the size of the available payload for 
 that block and whether the block is allocated or available for use. When a block is not allocated (ie free), the payload space holds
 pointers to other free blocks. To support the storage of 2 8-byte pointers, a minimum payload size of 16-bytes is enforced (resulting in
 a minimum block size of 24 bytes).
 
+SIDE LINKS: With MyHeapOptions.side_link_slots set, the end of the segment holds a table of that many SideLinks slots, split evenly 
+between the shards, and a free block keeps its list links in a slot instead of its payload. The free list links point at the links 
+of the neighboring blocks, wherever those are kept, and a slot also records its block's address and payload size, so a walk over 
+side-linked blocks reads only the table and never a block header. The slot index is stored in the upper bits of the free block's 
+status word, for when the links of a known block are needed, and update_boundary copies the payload size into the slot whenever 
+it changes. Only the header and footer of a free block are written, so the pages in between are never dirtied by the allocator. A 
+shard that runs out of slots keeps the links of its further free blocks in their payloads, as usual, and a walk reads the header 
+of those blocks, which sits next to their links.
+
+ALLOCATION TAGS: mymalloc_tagged stores a tag id in the status word of an allocated block, above the boundary tag bits, and adds the 
+payload size to that tag's counter. free_block subtracts it again, whichever path frees the block, and myrealloc moves the charge 
+along with the payload. The counters are updated atomically, so myheap_tag_bytes can be read at any time. Tagged blocks are never 
+cached on the quick lists. Untagged blocks (tag 0) are not counted, so the normal paths pay nothing.
+
+BOUNDARY TAGS: The status word of a header also records whether the block to its left is free (BLOCK_PREV_FREE) and, if so, whether 
+that block has the minimum payload (BLOCK_PREV_MIN). A free block with a larger payload keeps a copy of its payload size in the last 
+4 bytes of its payload, so a block can always find a free left neighbor. Freeing coalesces in both directions, and every split merges 
+its free remainder with the block to its right, so no two adjacent blocks in a shard are ever both free.
+
 FREE BLOCK LIST: A doubly linked listed is used to track and manage the available free blocks. As indicated above, the pointers to the
 previous and next free blocks are stored in the payload space of an un-allocated memory block. The relative order of the blocks within memory
 is not preserved via the free block list. However, the payload size information in the header of memory blocks can be used to traverse the
 heap in order, if desired.
 
 SUPPORTED FUNCTIONALITY: The interface supports mymalloc, myrealloc, and myfree functionalities, which map onto the standard malloc, 
-realloc, and free functions provided in C.
+realloc, and free functions provided in C. Extensions beyond the standard interface are declared in explicit.h.
+
+SNAPSHOTS: myheap_snapshot copies the segment and the allocator globals into a caller-provided buffer, and myheap_restore returns the 
+heap to that exact state. Restoring only writes the pages that changed since the snapshot was taken, but finding them takes a 
+comparison of every page against the snapshot, so a restore reads the whole segment and the whole snapshot however few pages were 
+dirtied. Restores cost time proportional to the segment size, not to the amount of change. Tracking dirty pages directly would need 
+soft-dirty bits (/proc/self/clear_refs and pagemap) or write-protection faults, both of which act on the whole process, so it is 
+not done here. Both functions take every shard lock, but the quick lists, the transfer cache, and the per-slot counts are changed 
+by mymalloc_small and myfree_small without any lock, so the heap must be quiescent while either runs: no other thread may be inside 
+the allocator, or a snapshot may be torn and a restore may corrupt the lists.
+
+LIFETIME HINTS: mymalloc_flags accepts hints about how long an object will live and how often it will be touched. Long-lived and cold 
+objects are carved from the high end of the highest-addressed free block that fits; the two hints share that placement, since both 
+describe objects that should stay out of the way of the working set. Short-lived objects take the lowest-addressed free block that 
+fits and are carved from its low end, so their churn stays at the bottom of the segment and the holes it leaves are reused by the 
+next short-lived objects rather than opened up between long-lived ones. Hot objects are placed with mymalloc_near next to the 
+previous hot allocation, so the objects touched most often share pages and TLB entries. When several hints are given, long-lived or 
+cold wins over hot, and hot over short-lived. Unhinted objects take the normal first-fit search.
+
+LOCALITY: mymalloc_near prefers a free block on the same page as a given pointer, then one on the same huge page, and only then falls 
+back to the first fit. Linked structures allocated with it keep parents and children close together, reducing cache and TLB misses 
+when they are traversed.
+
+mymalloc_cacheline rounds the payload up to whole cache lines and places it on a line boundary, splitting off the leading part of 
+the free block it is carved from, so while it is live no other object shares its lines (false sharing). Quick list refills use the 
+same placement for their batches: each batch starts on a line boundary and spans whole lines, so a freshly carved batch shares no 
+line with blocks carved for another slot. That only holds for the first use of each block. myfree_small pushes a block onto the 
+freeing thread's list, whichever slot carved it, and the transfer cache moves whole batches between slots, so once blocks are freed 
+by other threads, the blocks on one slot's list can share lines with blocks in use by another thread. Objects that threads write 
+heavily should come from mymalloc_cacheline; cachescratch.c measures both.
+
+FAST PATH: Small blocks (payloads of at most QUICK_MAX_PAYLOAD bytes) can be recycled through per-size-class quick lists declared in 
+explicit.h. mymalloc_small and myfree_small are static inline functions that pop and push those lists at the call site. Blocks on a 
+quick list stay marked as allocated in the heap, so they are never coalesced. When a list is empty, the out-of-line 
+mymalloc_quick_refill carves a batch of blocks from a single find_fit. When the heap runs out of space, mymalloc flushes the quick 
+lists back into the heap before giving up.
+
+THREAD SAFETY: The quick lists are lock-free Treiber stacks. Each head is a 64-bit word holding the 32-bit segment offset of the top 
+block and a 32-bit version tag that changes on every push and pop, so a compare-and-swap fails if the head was popped and pushed back 
+in between (the ABA problem). Everything else (the free lists, partitioning, and coalescing) is protected by shard locks, which 
+the quick list fast path never takes.
+
+Each size class has QUICK_NUM_SLOTS quick lists. A thread is given its own slot, round robin, the first time it uses the fast path. 
+When explicit.h is compiled with MYHEAP_PER_CPU, the slot is instead the CPU the thread is running on (looked up through glibc's 
+rseq-backed sched_getcpu), so hundreds of threads on a few cores share one cache per core instead of holding one each. Threads 
+fall back to their own slot if the CPU cannot be determined. Because every list is lock-free, a thread migrating between CPUs 
+mid-operation is harmless.
+
+To stop a thread that mostly frees from hoarding blocks that a thread that mostly allocates keeps refilling from the heap, each 
+size class also has a shared transfer cache. A quick list that reaches QUICK_MAX_CACHED blocks donates all of them to the transfer 
+cache, cut into batches of at most QUICK_TRANSFER_BATCH blocks. The transfer cache is itself a lock-free stack of batches, and the 
+first block of each batch records the batch's last block and length, so a batch moves between lists with one compare-and-swap and 
+no walk. A slot whose list is empty steals a single batch before it falls back to carving blocks under a shard lock, keeping one 
+block and caching the rest. Since a batch is only half of QUICK_MAX_CACHED, a stolen batch leaves the slot well short of donating 
+again, so blocks do not bounce between the transfer cache and a slot that alternates between allocating and freeing.
+
+SHARDS: The segment can be split into MyHeapOptions.num_shards equal address ranges (the last also takes any remainder). Each shard 
+has its own lock and its own free list, and coalescing never crosses a shard boundary, so a block always belongs to the shard its 
+address falls in. Allocations start at the calling thread's home shard (chosen from its quick list slot) and move on to the other 
+shards in order when it has no fit, so independent threads allocate and free large blocks in parallel. By default there is a single 
+shard and the allocator behaves exactly as an unsharded heap. Since a block cannot span two shards, the largest request a sharded 
+heap can serve is about the segment size divided by the number of shards, however empty the heap is: with 4 shards, an 8MB segment 
+cannot serve a 3MB request. Such requests fail at once, without flushing the quick lists or running the reclaimers, which could 
+not help. A program that needs requests of a given size should pass it as MyHeapOptions.max_request_size, and init then fails if 
+the shards would be too small for it.
+
+PREFAULTING: The first write to each page of the segment takes a page fault. MyHeapOptions.prefault touches every page during init, 
+and MyHeapOptions.lock_pages also mlocks the segment so it is never paged out. Without prefault, myheap_warm faults the segment in 
+incrementally from a shared cursor, in address order, which is the order first fit hands out blocks, so a background thread can stay 
+ahead of the allocations. Pages are touched with an atomic add of zero, which forces a write fault without changing their contents, 
+so warming is safe while other threads use the heap.
+
+MEMORY PRESSURE: Usage is the number of bytes, headers included, that are not on a free list, so blocks cached on the quick lists 
+count as used. Each shard keeps the size of its free list up to date in add_block and remove_block. Callers can register reclaimer 
+callbacks and set soft and hard usage limits. The reclaimers are asked to free memory once when an allocation pushes usage above 
+the soft limit (and again only after usage has fallen back below it), when an allocation would push usage above the hard limit, and 
+when no free block fits. The allocation is then retried once. Reclaimers always run with no shard lock held, so they can call 
+myfree, and a reclaimer that allocates never triggers another reclaim.
+
+RESERVE: MyHeapOptions.reserve_size bytes at the end of the segment can be set aside as a reserve shard. The reserve has its own lock 
+and free list and is never searched by ordinary allocations, quick list refills, or the usage limits, so normal traffic can neither 
+exhaust nor fragment it. mymalloc_flags with MYMALLOC_CRITICAL allocates from the reserve first and falls back to the main heap 
+only when the reserve has no fit. Freed reserve blocks always go back to the reserve, and myfree_small never caches them.
+
+ASYNC FREE: myfree_async hands a pointer to a background reclaimer thread instead of coalescing it inline. Each calling thread owns 
+a single-producer, single-consumer ring of ASYNC_RING_SIZE pointers, so queueing a free is one store into the ring and one release 
+store of its tail. The reclaimer, started the first time myfree_async is called, drains every ring in batches, holding a shard lock 
+across consecutive pointers from the same shard. When a thread's ring is full, or every ring has been claimed, the pointer is freed 
+inline. An allocation that finds no fit drains the rings itself before it flushes the quick lists or runs the reclaimers, so queued 
+frees are never the reason an allocation fails. Pointers still queued are not part of a snapshot, so callers should call 
+myheap_drain_async first.
+
+INCREMENTAL CHECKING: validate_heap_full walks the whole heap, which is too slow to run on every call, so validate_heap, which the 
+test harness calls after every request, only runs it when the allocator is built with MYHEAP_VALIDATE. With 
+MyHeapOptions.check_per_op set to K, every allocation, free, and in-place realloc, whichever entry point it came through (the 
+reserve, the near search, and quick list refills included), also checks the next K blocks of the shard it locked, in address order, 
+and the next K links of that shard's free list, continuing from per-shard cursors and wrapping around at the end. Any corruption is 
+reported within a bounded number of operations at a fixed cost per operation. Cursors that point at a block absorbed by coalescing, 
+or at a link removed from the list, are moved so they always point at a live block. A failed check prints what it found and hits a 
+breakpoint.
+
+TRACING: When <sys/sdt.h> is available (and MYHEAP_NO_USDT is not defined), the allocator is built with USDT probes under the 
+"myheap" provider: malloc_entry, malloc_return, free, realloc_entry, realloc_return, find_fit (with the number of free blocks it 
+looked at), partition, and coalesce (with the number of blocks merged). Each probe is a single nop until a tracer such as bpftrace 
+attaches to it, e.g. bpftrace -e 'usdt:./prog:myheap:find_fit { @scanned = hist(arg1); }'. Without <sys/sdt.h> they compile away.
+
+TUNING: The fit policy (MYHEAP_FIT_POLICY), the smallest remainder worth splitting off a block (SPLIT_THRESHOLD), the largest 
+quick list payload (QUICK_MAX_PAYLOAD), and the quick list refill batch (QUICK_REFILL_BATCH) can be overridden by defining them on 
+the command line or in a myheap_config.h on the include path. tuner.c writes such a header from recorded allocation traces.
+
+ADAPTIVE PLACEMENT: With MyHeapOptions.adaptive set, each shard chooses between first fit and best fit at run time. Every 
+ADAPT_WINDOW find_fit calls on a shard, the policy is re-evaluated from the share of free bytes outside the largest free block, 
+measured over the first ADAPT_SAMPLE blocks of the free list, so an evaluation costs at most a few blocks per call however long 
+the list grows. A shard whose free space is fragmented switches to best fit, which packs requests into the smallest holes, and 
+the quick lists are flushed so the blocks they hold back can coalesce. A shard switches back to first fit when its free space is 
+mostly one block again. Best fit under adaptive placement is bounded: the search stops ADAPT_MAX_SCAN blocks past the first block 
+that fits and takes the smallest it has seen, so a long free list costs a best fit search only a fixed amount more than a first 
+fit search. The thresholds can be overridden like the TUNING macros. 
 
 PERFORMANCE: To reduce external fragmentation, consolidation of contiguous free bocks is performed when freeing and reallocating blocks. 
 To reduce internal fragmentation, partitioning of blocks is performed when mallocing and reallocing. Utilization is fairly good in testing 
@@ -23,13 +160,76 @@ To reduce internal fragmentation, partitioning of blocks is performed when mallo
 mallocing or reallocing. 
 */
 #include "allocator.h"
+#include "explicit.h"
 #include "debug_break.h"
 #include <string.h>
 #include <stdio.h>
-
-#define HEADER_SIZE 8 // size of header, in bytes
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#if defined(__has_include) && !defined(MYHEAP_NO_USDT)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MYHEAP_USDT 1
+#endif
+#endif
+
+#ifdef MYHEAP_USDT
+#define PROBE1(name, a) DTRACE_PROBE1(myheap, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(myheap, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(myheap, name, a, b, c)
+#else
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#endif
+
+#define HEADER_SIZE MYHEAP_HEADER_SIZE // size of header, in bytes
 #define MIN_PAYLOAD_SIZE 16 // limit to ensure space for pointers
 #define MIN_BLOCK_SIZE 24
+#ifndef SPLIT_THRESHOLD
+#define SPLIT_THRESHOLD MIN_BLOCK_SIZE // smallest free remainder worth splitting off an allocated block
+#endif
+#if SPLIT_THRESHOLD < MIN_BLOCK_SIZE || SPLIT_THRESHOLD % ALIGNMENT != 0
+#error "SPLIT_THRESHOLD must be a multiple of ALIGNMENT of at least MIN_BLOCK_SIZE"
+#endif
+#define CACHE_LINE_SIZE 64
+#define PAGE_SIZE 4096 // granularity used when restoring snapshots and placing blocks near each other
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#ifndef ADAPT_WINDOW
+#define ADAPT_WINDOW 1024 // find_fit calls on a shard between evaluations of its fit policy
+#endif
+#ifndef ADAPT_FRAG_HIGH
+#define ADAPT_FRAG_HIGH 50 // percent of free bytes outside the largest free block at which first fit gives way to best fit
+#endif
+#ifndef ADAPT_FRAG_LOW
+#define ADAPT_FRAG_LOW 20 // percent at which best fit gives way to first fit again
+#endif
+#ifndef ADAPT_MAX_SCAN
+#define ADAPT_MAX_SCAN 64 // free blocks a best fit search under adaptive placement examines past the first block that fits
+#endif
+#ifndef ADAPT_SAMPLE
+#define ADAPT_SAMPLE (4 * ADAPT_WINDOW) // free blocks an evaluation of the fit policy examines at most
+#endif
+#ifndef QUICK_REFILL_BATCH
+#define QUICK_REFILL_BATCH 8 // blocks carved per quick list refill
+#endif
+#if QUICK_REFILL_BATCH < 1
+#error "QUICK_REFILL_BATCH must be at least 1"
+#endif
+#define QUICK_TRANSFER_BATCH (QUICK_MAX_CACHED / 2) // most blocks a refill steals from a transfer cache at once
+#define MAX_SHARDS 64
+#define BLOCK_ALLOCATED 0x1 // status bits of a header
+#define BLOCK_PREV_FREE 0x2 // block to the left, in the same shard, is free
+#define BLOCK_PREV_MIN 0x4 // free block to the left has MIN_PAYLOAD_SIZE and no room for a footer
+#define BLOCK_SIDE_LINKS 0x8 // free block's links are in the side table slot held in the bits from LINK_SLOT_SHIFT up
+#define LINK_SLOT_SHIFT 4
+#define BLOCK_TAG_SHIFT MYHEAP_TAG_SHIFT // allocated blocks keep their tag in the same bits
+#define ASYNC_RING_SIZE 256 // pointers queued per thread by myfree_async, must be a power of two
+#define ASYNC_MAX_RINGS 64 // threads that can use myfree_async at once, later threads free inline
+#define ASYNC_IDLE_NS 100000 // reclaimer sleep after a pass that found nothing to free
 
 /* ------------------
  * GLOBAL VARS 
@@ -37,329 +237,2160 @@ mallocing or reallocing.
  */
 static void *segment_start;
 static void *segment_end;
-static void *free_list_start;
 static size_t segment_size;
+static size_t num_shards; // shards of the main heap
+static size_t num_reserve_shards; // 1 if the reserve shard follows the main heap shards, otherwise 0
+static size_t shard_size; // size of every shard but the last, which also takes the remainder of the segment
+
+// read and written inline by explicit.h
+uint64_t myheap_quick_heads[QUICK_NUM_SLOTS][QUICK_NUM_CLASSES];
+unsigned char *myheap_quick_base;
+__thread unsigned int myheap_quick_thread_slot;
+unsigned char *myheap_reserve_start;
+int32_t myheap_quick_counts[QUICK_NUM_SLOTS][QUICK_NUM_CLASSES];
+static uint64_t quick_transfer_heads[QUICK_NUM_CLASSES]; // shared by every slot, only used out of line
+static unsigned int next_quick_slot; // next slot handed out by myheap_quick_assign_slot
+static pthread_once_t reclaimer_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t async_drain_lock = PTHREAD_MUTEX_INITIALIZER; // only one thread consumes the rings at a time
+static unsigned int num_async_rings; // rings claimed so far
+static size_t tag_bytes[MYHEAP_MAX_TAGS]; // payload bytes allocated under each tag
+static size_t check_per_op; // 0 when incremental checking is off
+static bool adaptive; // shards switch fit policies at run time
+static bool quick_flush_wanted; // a shard switched to best fit and the quick lists should be returned to the heap
+static void *last_hot_ptr; // payload of the last MYMALLOC_HOT allocation, the next one is placed near it
+static size_t warm_offset; // offset of the first page myheap_warm has not touched yet
+static size_t soft_limit; // 0 when unset
+static size_t hard_limit; // 0 when unset
+static bool soft_limit_crossed; // reclaimers already ran for the current excursion above soft_limit
+static pthread_mutex_t reclaimer_lock = PTHREAD_MUTEX_INITIALIZER; // guards the reclaimer table
+static size_t num_reclaimers;
+static __thread bool in_reclaim; // set while this thread runs the reclaimers
 
 /* ------------------
  * STRUCTS
  * ------------------
 */
 
-// 16-byte struct to hold pointers
-typedef struct Pointers {
-    void *previous;
-    void *next;
-} Pointers;
+// 16-byte struct to hold the free list links of a block, which point at the links of its neighbors on the list
+typedef struct Pointers {
+    struct Pointers *previous;
+    struct Pointers *next;
+} Pointers;
+
+// side table slot, the links come first so that a pointer to the slot is a pointer to its links
+typedef struct SideLinks {
+    Pointers links;
+    void *block;
+    unsigned int payload; // copy of the block's payload size
+} SideLinks;
+
+// 8-byte struct to hold block header
+typedef struct Header {
+    unsigned int payload;
+    unsigned int status; // BLOCK_* bits
+} Header;
+
+// independently locked address range of the segment with its own free list
+typedef struct Shard {
+    pthread_mutex_t lock; // guards the free list and every block header in the range
+    void *start;
+    void *end;
+    Pointers *free_list_start; // links of the first free block
+    size_t free_bytes; // total size, headers included, of the blocks on the free list
+    Pointers *free_slots; // links of the unused side table slots of the shard, chained through their next fields
+    void *check_block; // next block for the incremental checker, NULL to start over
+    Pointers *check_link; // links of the next free list block for the incremental checker, NULL to start over
+    int fit_policy; // MYHEAP_FIT_FIRST or MYHEAP_FIT_BEST, only changed at run time when adaptive placement is on
+    size_t window_fits; // find_fit calls since the fit policy was last evaluated
+} Shard;
+
+static Shard shards[MAX_SHARDS];
+static SideLinks *side_table; // NULL unless side links are on
+static size_t side_table_bytes;
+
+// kept in the payload of the first block of a batch on a transfer cache, whose blocks are chained as on a quick list
+typedef struct TransferBatch {
+    uint32_t next_block; // the field every quick list block is chained through
+    uint32_t next_batch; // first block of the batch below this one on the transfer cache
+    uint32_t last_block;
+    uint32_t num_blocks;
+} TransferBatch;
+
+// callback registered with myheap_register_reclaimer
+typedef struct Reclaimer {
+    myheap_reclaimer fn;
+    void *arg;
+} Reclaimer;
+
+static Reclaimer reclaimers[MYHEAP_MAX_RECLAIMERS];
+
+// pointers queued by one thread's myfree_async, written only by that thread and read only under async_drain_lock
+typedef struct AsyncRing {
+    uint32_t head; // next slot to drain, advanced by the consumer
+    char pad[60]; // keep the producer and consumer indices on separate cache lines
+    uint32_t tail; // next slot to fill, advanced by the producer
+    void *slots[ASYNC_RING_SIZE];
+} AsyncRing;
+
+static AsyncRing async_rings[ASYNC_MAX_RINGS];
+static __thread AsyncRing *thread_async_ring;
+
+// allocator globals saved at the front of a snapshot buffer, followed by a copy of the segment
+typedef struct Snapshot {
+    void *segment_start;
+    size_t segment_size;
+    size_t num_shards;
+    unsigned char *reserve_start;
+    void *free_list_starts[MAX_SHARDS];
+    size_t free_bytes[MAX_SHARDS];
+    Pointers *free_slots[MAX_SHARDS];
+    int fit_policies[MAX_SHARDS];
+    size_t window_fits[MAX_SHARDS];
+    bool quick_flush_wanted;
+    void *last_hot_ptr;
+    size_t tag_bytes[MYHEAP_MAX_TAGS];
+    uint64_t quick_heads[QUICK_NUM_SLOTS][QUICK_NUM_CLASSES];
+    int32_t quick_counts[QUICK_NUM_SLOTS][QUICK_NUM_CLASSES];
+    uint64_t quick_transfer_heads[QUICK_NUM_CLASSES];
+} Snapshot;
+
+
+/* ----------------
+ * UTILITIES
+ * ----------------
+ */
+
+/* 
+Function: align
+Input: size_t number and size_t number
+Output: size_t number
+========================================
+This function rounds the given number "size" to be a multiple of "mult" 
+*/
+size_t align(size_t size, size_t mult) {
+    return (size + (mult - 1)) & ~(mult - 1);
+}
+
+/* 
+Function: get_aligned_size
+Input: size_t number
+Output: size_t number
+========================================
+This function converts a requested payload size into the payload size actually reserved for it, which is aligned and 
+at least large enough to hold the free list pointers once the block is freed 
+*/
+size_t get_aligned_size(size_t requested_size) {
+    size_t aligned_size = align(requested_size, ALIGNMENT);
+    if (aligned_size < MIN_PAYLOAD_SIZE) {
+        aligned_size = MIN_PAYLOAD_SIZE;
+    }
+    return aligned_size;
+}
+
+/* 
+Function: get_shard
+Input: Void pointer
+Return Value: Pointer to a Shard
+=================================
+Given a pointer to the start/header of a block, this function returns the shard whose address range contains it 
+*/
+Shard *get_shard(void *block) {
+    if ((unsigned char *)block >= myheap_reserve_start) {
+        return &shards[num_shards];
+    }
+    size_t index = ((unsigned char *)block - (unsigned char *)segment_start) / shard_size;
+    return &shards[index < num_shards ? index : num_shards - 1];
+}
+
+/* 
+Function: get_home_shard
+Input: None
+Return Value: Size_t number
+=============================
+This function returns the index of the shard the calling thread should try first, spreading threads across the shards by 
+their quick list slot 
+*/
+size_t get_home_shard(void) {
+    return myheap_quick_slot() % num_shards;
+}
+
+/* 
+Function: get_payload_ptr
+Input: Void Pointer
+Return Value: Void Pointer
+=============================
+Given a pointer to the start/header of a block, this function returns a pointer to the start of the payload 
+for that block 
+*/
+void *get_payload_ptr(void *block) {
+    return (unsigned char *)block + HEADER_SIZE;
+}
+
+
+/* --------------------------
+ * BOUNDARY TAG FUNCTIONS
+ * --------------------------
+ */
+
+/* 
+Function: is_allocated
+Input: Void pointer
+Return Value: Boolean
+=======================
+Given a pointer to the start/header of a block, this function returns whether the block is allocated 
+*/
+bool is_allocated(void *block) {
+    return (((Header *)block)->status & BLOCK_ALLOCATED) != 0;
+}
+
+/* 
+Function: update_boundary
+Input: Void pointer
+Return Value: None
+=======================
+This function must be called whenever a block's size or allocation status changes. If the block is free and has room, it writes 
+the block's footer, and it sets the BLOCK_PREV_FREE and BLOCK_PREV_MIN bits of the next block to match. The next block's bits are 
+left alone if it belongs to another shard. The lock of the block's shard must be held. 
+*/
+void update_boundary(void *block) {
+    unsigned int payload = ((Header *)block)->payload;
+    bool is_free = !is_allocated(block);
+    if (is_free && payload > MIN_PAYLOAD_SIZE) {
+        *(unsigned int *)((unsigned char *)block + HEADER_SIZE + payload - sizeof(unsigned int)) = payload;
+    }
+
+    if (is_free && (((Header *)block)->status & BLOCK_SIDE_LINKS)) {
+        side_table[((Header *)block)->status >> LINK_SLOT_SHIFT].payload = payload;
+    }
+
+    void *next_block = (unsigned char *)block + HEADER_SIZE + payload;
+    if (next_block < get_shard(block)->end) {
+        unsigned int status = ((Header *)next_block)->status & ~(BLOCK_PREV_FREE | BLOCK_PREV_MIN);
+        if (is_free) {
+            status |= BLOCK_PREV_FREE | (payload == MIN_PAYLOAD_SIZE ? BLOCK_PREV_MIN : 0);
+        }
+        __atomic_store_n(&((Header *)next_block)->status, status, __ATOMIC_RELAXED); // myfree_small reads it unlocked
+    }
+}
+
+/* 
+Function: get_free_left_block
+Input: Void pointer
+Return Value: Void pointer
+=============================
+Given a pointer to the start/header of a block, this function returns the block to its left if that block is free and in the 
+same shard, using the boundary tags. Otherwise, NULL is returned. 
+*/
+void *get_free_left_block(void *block) {
+    unsigned int status = ((Header *)block)->status;
+    if (!(status & BLOCK_PREV_FREE) || block == get_shard(block)->start) {
+        return NULL;
+    }
+    if (status & BLOCK_PREV_MIN) {
+        return (unsigned char *)block - MIN_BLOCK_SIZE;
+    }
+
+    unsigned int left_payload = *(unsigned int *)((unsigned char *)block - sizeof(unsigned int));
+    return (unsigned char *)block - left_payload - HEADER_SIZE;
+}
+
+
+/* --------------------------
+ * FREE BLOCK LIST FUNCTIONS
+ * --------------------------
+ */
+
+/* 
+Function: get_links
+Input: Void pointer
+Return Value: Pointer to Pointers
+=================================
+Given a pointer to the start/header of a free block, this function returns where its free list links are kept: its side table 
+slot if it has one, otherwise the start of its payload 
+*/
+Pointers *get_links(void *block) {
+    unsigned int status = ((Header *)block)->status;
+    if (status & BLOCK_SIDE_LINKS) {
+        return &side_table[status >> LINK_SLOT_SHIFT].links;
+    }
+    return (Pointers *)get_payload_ptr(block);
+}
+
+/* 
+Function: in_side_table
+Input: Pointer to Pointers
+Return Value: Boolean
+=================================
+This function returns true if the given free list links are kept in a side table slot rather than in a payload. 
+*/
+bool in_side_table(Pointers *links) {
+    return (unsigned char *)links >= (unsigned char *)side_table &&
+           (unsigned char *)links < (unsigned char *)side_table + side_table_bytes;
+}
+
+/* 
+Function: get_link_block
+Input: Pointer to Pointers
+Return Value: Void pointer
+=================================
+This function is the inverse of get_links. Given the free list links of a block, it returns the start/header of the block, 
+without reading the block if the links are in the side table. 
+*/
+void *get_link_block(Pointers *links) {
+    if (in_side_table(links)) {
+        return ((SideLinks *)links)->block;
+    }
+    return (unsigned char *)links - HEADER_SIZE;
+}
+
+/* 
+Function: get_link_payload
+Input: Pointer to Pointers
+Return Value: Unsigned integer
+=================================
+Given the free list links of a block, this function returns the block's payload size, from its side table slot if it has one 
+and from its header otherwise. 
+*/
+unsigned int get_link_payload(Pointers *links) {
+    if (in_side_table(links)) {
+        return ((SideLinks *)links)->payload;
+    }
+    return ((Header *)((unsigned char *)links - HEADER_SIZE))->payload;
+}
+
+/* 
+Function: adjust_tag_bytes
+Input: Void pointer and a long number
+Return Value: None
+=================================
+This function adds the given (possibly negative) number of bytes to the counter of the allocated block's tag, if it has one. The 
+lock of the block's shard must be held. 
+*/
+void adjust_tag_bytes(void *block, long delta) {
+    unsigned int tag = ((Header *)block)->status >> BLOCK_TAG_SHIFT;
+    if (tag != 0 && delta != 0) {
+        __atomic_fetch_add(&tag_bytes[tag], delta, __ATOMIC_RELAXED);
+    }
+}
+
+/* 
+Function: set_tag
+Input: Void pointer and unsigned integer
+Return Value: None
+=================================
+This function tags an untagged allocated block and charges its payload to the tag. It takes the block's shard lock, since 
+neighbors update the boundary bits in the same status word. 
+*/
+void set_tag(void *block, unsigned int tag) {
+    Shard *shard = get_shard(block);
+    pthread_mutex_lock(&shard->lock);
+    ((Header *)block)->status |= tag << BLOCK_TAG_SHIFT;
+    adjust_tag_bytes(block, ((Header *)block)->payload);
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/* 
+Function: adjust_free_bytes
+Input: Pointer to a Shard and a long number
+Return Value: None
+=================================
+This function adds the given (possibly negative) number of bytes to the shard's free byte count. The shard's lock must be held, 
+but the count is stored atomically because myheap_usage reads it without any lock. 
+*/
+void adjust_free_bytes(Shard *shard, long delta) {
+    __atomic_store_n(&shard->free_bytes, shard->free_bytes + delta, __ATOMIC_RELAXED);
+}
+
+/* 
+Function: add_block
+Input: Void pointer
+Return Value: None
+=========================
+Adds the given block to the front of its shard's free list and does any necessary list and header maintenance 
+*/
+void add_block(void *block) {
+    Shard *shard = get_shard(block);
+    ((Header *)block)->status &= BLOCK_PREV_FREE | BLOCK_PREV_MIN; // drops any tag
+    Pointers *slot = shard->free_slots;
+    if (slot != NULL) { // take a side table slot for the links
+        shard->free_slots = slot->next;
+        ((SideLinks *)slot)->block = block;
+        ((Header *)block)->status |= BLOCK_SIDE_LINKS | (unsigned int)((SideLinks *)slot - side_table) << LINK_SLOT_SHIFT;
+    }
+    Pointers *links = get_links(block);
+    links->previous = NULL;
+    links->next = shard->free_list_start;
+    if (shard->free_list_start != NULL) {
+        shard->free_list_start->previous = links;
+    }
+
+    shard->free_list_start = links;
+    adjust_free_bytes(shard, ((Header *)block)->payload + HEADER_SIZE);
+    update_boundary(block);
+}
+
+/* 
+Function: remove_block
+Input: Void pointer
+Return Value: None
+=======================
+This function removes the given block from its shard's free list 
+*/
+void remove_block(void *block) {
+    Shard *shard = get_shard(block);
+    Pointers *links = get_links(block);
+    Pointers *previous = links->previous;
+    Pointers *next = links->next;
+
+    if (previous == NULL) { // first free block
+        shard->free_list_start = next;
+    } else {
+        previous->next = next;
+    }
+    if (next != NULL) {
+        next->previous = previous;
+    }
+
+    if (shard->check_link == links) { // the checker starts its list walk over
+        shard->check_link = NULL;
+    }
+    if (((Header *)block)->status & BLOCK_SIDE_LINKS) { // give the slot back
+        links->next = shard->free_slots;
+        shard->free_slots = links;
+    }
+    ((Header *)block)->status = (((Header *)block)->status & (BLOCK_PREV_FREE | BLOCK_PREV_MIN)) | BLOCK_ALLOCATED;
+    adjust_free_bytes(shard, -(long)(((Header *)block)->payload + HEADER_SIZE));
+    update_boundary(block);
+}
+
+    
+/* -------------
+ * HELPERS
+ * -------------
+ */
+
+/* 
+Function: coalesce_right
+Input: Void pointer
+Return Value: None
+=========================== 
+This function consolidates as many contiguous free blocks to the right of the given block as possible. Because the 
+free list is not in address order, this function traverses the heap via pointer arthimetic, utilizing header information. This function 
+also does the necessary free list and header maintenance associated with any consolidation of blocks. Consolidation stops at the end 
+of the block's shard. The block itself keeps its allocation status. 
+*/
+void coalesce_right(void *block) {
+    if (block == NULL) { // something went wrong
+        return;
+    }
+    
+    Shard *shard = get_shard(block);
+    void *curr_block = (char *)block + ((Header *)block)->payload + HEADER_SIZE;
+    int merged = 0;
+
+    while (curr_block < shard->end && !is_allocated(curr_block)) {
+        ((Header *)block)->payload += ((Header *)curr_block)->payload + HEADER_SIZE;
+        remove_block(curr_block);
+        if (shard->check_block == curr_block) {
+            shard->check_block = block;
+        }
+        merged++;
+
+        curr_block = (unsigned char *)curr_block + ((Header *)curr_block)->payload + HEADER_SIZE;
+    }
+    update_boundary(block);
+    PROBE3(coalesce, block, merged, ((Header *)block)->payload);
+}
+
+/* 
+Function: partition
+Input: Void pointer, size_t number, and size_t number
+Return Value: None
+=======================================================
+This function splits a given block into two given the available payload space and the given payload size. The free remainder 
+is merged with the block to its right if that block is also free. 
+*/
+void partition(void *block, size_t payload_space, size_t payload) {
+    void *next_block = (unsigned char *)block + payload + HEADER_SIZE;
+
+    // update block with new size
+    ((Header *)block)->payload = payload;
+
+    unsigned int next_payload = payload_space - payload - HEADER_SIZE;
+    if (!is_allocated(block)) { // the remainder is counted again when it is added
+        adjust_free_bytes(get_shard(block), -(long)(next_payload + HEADER_SIZE));
+    }
+    ((Header *)next_block)->payload = next_payload;
+    ((Header *)next_block)->status = BLOCK_ALLOCATED; // not on the free list yet
+    update_boundary(block);
+    PROBE3(partition, block, payload, next_payload);
+
+    // merge with the right neighbor, then add to free list
+    coalesce_right(next_block);
+    add_block(next_block);
+}
+
+/* 
+Function: partition_high
+Input: Void pointer, size_t number, and size_t number
+Return Value: Void pointer
+=======================================================
+This function is the mirror image of partition. It splits the given free block so that a block with the given payload size is 
+carved from its high end, and returns a pointer to that new block. The low end keeps the original header and stays on the free 
+list with a smaller payload, so no list maintenance is needed. 
+*/
+void *partition_high(void *block, size_t payload_space, size_t payload) {
+    unsigned int remaining_payload = payload_space - payload - HEADER_SIZE;
+    void *high_block = (unsigned char *)block + remaining_payload + HEADER_SIZE;
+
+    ((Header *)high_block)->payload = payload;
+    ((Header *)high_block)->status = BLOCK_ALLOCATED;
+    // update the free block with its new size
+    ((Header *)block)->payload = remaining_payload;
+    adjust_free_bytes(get_shard(block), -(long)(payload + HEADER_SIZE));
+    update_boundary(block);
+    update_boundary(high_block);
+
+    return high_block;
+}
+
+/* 
+Function: place_block
+Input: Void pointer and size_t number
+Return Value: None
+=======================================
+Given a free block that is large enough to hold the payload size, this function partitions off any unneeded space and
+removes the block from the free list so that it is marked as allocated. 
+*/
+void place_block(void *block, size_t aligned_requested_size) {
+    unsigned int payload_space = ((Header *)block)->payload;
+    // partition the block if large enough
+    if (payload_space >= aligned_requested_size + SPLIT_THRESHOLD) {
+        partition(block, payload_space, aligned_requested_size);
+    }
+    remove_block(block);
+}
+
+/* 
+Function: adapt_fit_policy
+Input: Pointer to a Shard
+Return Value: None
+=======================================
+This function re-evaluates the shard's fit policy at the end of a window of find_fit calls and starts a new window. It walks 
+at most ADAPT_SAMPLE blocks of the free list to find the largest free block among them and the bytes they hold; when the walk 
+reaches the end of the list, those are all of the shard's free bytes. The shard moves to best fit when at least 
+ADAPT_FRAG_HIGH percent of the sampled bytes lie outside the largest sampled block, and asks for the quick lists to be flushed, 
+and moves back to first fit when that share falls to ADAPT_FRAG_LOW. The shard's lock must be held. 
+*/
+void adapt_fit_policy(Shard *shard) {
+    shard->window_fits = 0;
+
+    size_t sampled_blocks = 0;
+    size_t sampled_bytes = 0;
+    size_t largest = 0;
+    for (Pointers *links = shard->free_list_start; links != NULL && sampled_blocks < ADAPT_SAMPLE; links = links->next) {
+        size_t block_bytes = get_link_payload(links) + HEADER_SIZE;
+        sampled_blocks++;
+        sampled_bytes += block_bytes;
+        if (block_bytes > largest) {
+            largest = block_bytes;
+        }
+    }
+    size_t fragmented_pct = sampled_bytes > 0 ? 100 - largest * 100 / sampled_bytes : 0;
+
+    if (shard->fit_policy == MYHEAP_FIT_FIRST && fragmented_pct >= ADAPT_FRAG_HIGH) {
+        shard->fit_policy = MYHEAP_FIT_BEST;
+        __atomic_store_n(&quick_flush_wanted, true, __ATOMIC_RELAXED);
+    } else if (shard->fit_policy == MYHEAP_FIT_BEST && fragmented_pct <= ADAPT_FRAG_LOW) {
+        shard->fit_policy = MYHEAP_FIT_FIRST;
+    }
+}
+
+/* 
+Function: find_fit 
+Input: Pointer to a Shard and size_t number
+Return Value: Void pointer
+======================
+This function traverses the shard's explicit list of free blocks to find a suitable free block given the payload size.
+Under the shard's fit policy (MYHEAP_FIT_POLICY unless adaptive placement changed it), that is the first block large enough 
+for MYHEAP_FIT_FIRST, or the smallest for MYHEAP_FIT_BEST, where the traversal stops early on an exact fit and, under 
+adaptive placement, ADAPT_MAX_SCAN blocks past the first block that fits. It returns a pointer to the block, or NULL if a 
+block cannot be found. If a suitable block is found, find_fit also performs the necessary list and header maintenance to 
+indicate the block is allocated. The shard's lock must be held. 
+*/
+void *find_fit(Shard *shard, size_t aligned_requested_size) {
+    Pointers *curr_links = shard->free_list_start;
+    Pointers *best_links = NULL;
+    unsigned int best_payload = 0;
+    size_t candidates = 0;
+    size_t past_first_fit = 0;
+
+    while (curr_links != NULL) {
+        if (best_links != NULL && adaptive && past_first_fit++ == ADAPT_MAX_SCAN) {
+            break;
+        }
+        candidates++;
+        unsigned int payload = get_link_payload(curr_links);
+        if (payload >= aligned_requested_size && (best_links == NULL || payload < best_payload)) {
+            best_links = curr_links;
+            best_payload = payload;
+            if (shard->fit_policy == MYHEAP_FIT_FIRST || payload == aligned_requested_size) {
+                break;
+            }
+        }
+
+        curr_links = curr_links->next;
+    }
+
+    void *best_block = best_links != NULL ? get_link_block(best_links) : NULL;
+    PROBE3(find_fit, aligned_requested_size, candidates, best_block);
+    if (best_block != NULL) {
+        place_block(best_block, aligned_requested_size);
+    }
+    if (adaptive) {
+        if (++shard->window_fits == ADAPT_WINDOW) {
+            adapt_fit_policy(shard);
+        }
+    }
+    return best_block;
+}
+
+/* 
+Function: find_fit_low
+Input: Pointer to a Shard and size_t number
+Return Value: Void pointer
+======================
+This function is used for short-lived allocations. It traverses the whole free list to find the suitable block at the lowest 
+address and places the allocation at the low end of that block. It returns a pointer to the allocated block, or NULL if a block 
+cannot be found. The shard's lock must be held. 
+*/
+void *find_fit_low(Shard *shard, size_t aligned_requested_size) {
+    void *best_block = NULL;
+
+    for (Pointers *links = shard->free_list_start; links != NULL; links = links->next) {
+        if (get_link_payload(links) >= aligned_requested_size && (best_block == NULL || get_link_block(links) < best_block)) {
+            best_block = get_link_block(links);
+        }
+    }
+
+    if (best_block != NULL) {
+        place_block(best_block, aligned_requested_size);
+    }
+    return best_block;
+}
+
+/* 
+Function: find_fit_high
+Input: Pointer to a Shard and size_t number
+Return Value: Void pointer
+======================
+This function is used for long-lived and cold allocations. Rather than taking the first suitable block, it traverses the whole 
+free list to find the suitable block at the highest address, and carves the allocation from the high end of that block. It 
+returns a pointer to the allocated block, or NULL if a block cannot be found. The shard's lock must be held. 
+*/
+void *find_fit_high(Shard *shard, size_t aligned_requested_size) {
+    void *best_block = NULL;
+
+    for (Pointers *links = shard->free_list_start; links != NULL; links = links->next) {
+        if (get_link_payload(links) >= aligned_requested_size && get_link_block(links) > best_block) {
+            best_block = get_link_block(links);
+        }
+    }
+
+    if (best_block == NULL) {
+        return NULL;
+    }
+
+    unsigned int payload_space = ((Header *)best_block)->payload;
+    if (payload_space >= aligned_requested_size + SPLIT_THRESHOLD) {
+        return partition_high(best_block, payload_space, aligned_requested_size);
+    }
+    remove_block(best_block);
+    return best_block;
+}
+
+/* 
+Function: find_fit_aligned
+Input: Pointer to a Shard, size_t number, and size_t number
+Return Value: Void pointer
+======================
+This function is a first-fit search for a block whose payload, less the given offset, starts on a cache line boundary. A free 
+block is suitable if such a position leaves either no leading space or enough for a free block of its own, and the payload 
+fits after it. The leading space stays on the free list and any trailing space is split off as usual. It returns a pointer 
+to the allocated block, or NULL if a block cannot be found. The shard's lock must be held. 
+*/
+void *find_fit_aligned(Shard *shard, size_t aligned_requested_size, size_t line_offset) {
+    Pointers *curr_links = shard->free_list_start;
+
+    while (curr_links != NULL) {
+        void *curr_block = get_link_block(curr_links);
+        unsigned char *payload_start = get_payload_ptr(curr_block);
+        unsigned char *payload_end = payload_start + get_link_payload(curr_links);
+        unsigned char *target = (unsigned char *)align((uintptr_t)(payload_start - line_offset), CACHE_LINE_SIZE) + line_offset;
+        if (target != payload_start && target - payload_start < MIN_BLOCK_SIZE) { // no room for the leading free block
+            target += CACHE_LINE_SIZE;
+        }
+
+        if (target + aligned_requested_size <= payload_end) {
+            if (target == payload_start) {
+                place_block(curr_block, aligned_requested_size);
+                return curr_block;
+            }
+
+            size_t payload_space = payload_end - target;
+            void *block = partition_high(curr_block, ((Header *)curr_block)->payload, payload_space);
+            if (payload_space >= aligned_requested_size + SPLIT_THRESHOLD) {
+                partition(block, payload_space, aligned_requested_size);
+            }
+            return block;
+        }
+
+        curr_links = curr_links->next;
+    }
+
+    return NULL;
+}
+
+/* 
+Function: find_fit_cacheline
+Input: Pointer to a Shard and size_t number
+Return Value: Void pointer
+======================
+This function is find_fit_aligned for payloads that start on a cache line, in the form taken by find_fit_in_shards. 
+*/
+void *find_fit_cacheline(Shard *shard, size_t aligned_requested_size) {
+    return find_fit_aligned(shard, aligned_requested_size, 0);
+}
+
+/* 
+Function: find_fit_near
+Input: Void pointer and size_t number
+Return Value: Void pointer
+==================================
+This function traverses the free list of the given block's shard looking for a suitable block close to the given block. A block 
+on the same page is taken immediately. Otherwise the first suitable block on the same huge page is preferred over the first suitable 
+block anywhere else in the shard. It returns a pointer to the allocated block, or NULL if a block cannot be found. The shard's lock 
+must be held. 
+*/
+void *find_fit_near(void *near_block, size_t aligned_requested_size) {
+    uintptr_t near_addr = (uintptr_t)near_block;
+    Pointers *curr_links = get_shard(near_block)->free_list_start;
+    void *same_huge_page = NULL;
+    void *first_fit = NULL;
+
+    while (curr_links != NULL) {
+        if (get_link_payload(curr_links) >= aligned_requested_size) {
+            void *curr_block = get_link_block(curr_links);
+            uintptr_t distance = (uintptr_t)curr_block ^ near_addr; // high bits differ once pages differ
+            if (distance < PAGE_SIZE) {
+                place_block(curr_block, aligned_requested_size);
+                return curr_block;
+            }
+            if (distance < HUGE_PAGE_SIZE && same_huge_page == NULL) {
+                same_huge_page = curr_block;
+            }
+            if (first_fit == NULL) {
+                first_fit = curr_block;
+            }
+        }
+        curr_links = curr_links->next;
+    }
+
+    void *block = same_huge_page != NULL ? same_huge_page : first_fit;
+    if (block != NULL) {
+        place_block(block, aligned_requested_size);
+    }
+    return block;
+}
+
+/* 
+Function: free_block
+Input: Void pointer
+Return Value: None
+=========================
+This function returns an allocated block to the heap, first coalescing it with any free blocks to its right and then with a free 
+block to its left, and adding the result to the free list. The lock of the block's shard must be held. 
+*/
+void free_block(void *block) {
+    adjust_tag_bytes(block, -(long)((Header *)block)->payload);
+    coalesce_right(block);
+
+    void *left_block = get_free_left_block(block);
+    if (left_block != NULL) {
+        remove_block(left_block);
+        ((Header *)left_block)->payload += ((Header *)block)->payload + HEADER_SIZE;
+        Shard *shard = get_shard(block);
+        if (shard->check_block == block) {
+            shard->check_block = left_block;
+        }
+        block = left_block;
+    }
+    add_block(block);
+}
+
+/* 
+Function: detach_quick_list
+Input: Pointer to a quick list head
+Return Value: Unsigned 32-bit integer
+========================================
+This function empties the given quick list with a single compare-and-swap and returns the offset of the first block of the 
+detached chain (QUICK_EMPTY if the list was already empty). Once detached, the chain is private to the calling thread. 
+*/
+uint32_t detach_quick_list(uint64_t *list) {
+    uint64_t head = __atomic_load_n(list, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(list, &head, QUICK_HEAD(QUICK_EMPTY, QUICK_TAG(head) + 1),
+                                        false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    }
+    return QUICK_OFFSET(head);
+}
+
+/* 
+Function: push_quick_chain
+Input: Pointer to a quick list head and two unsigned 32-bit integers
+Return Value: None
+========================================
+This function pushes a detached chain of blocks, running from the first to the last given offset, onto the given quick list 
+with a single compare-and-swap. 
+*/
+void push_quick_chain(uint64_t *list, uint32_t first_offset, uint32_t last_offset) {
+    uint32_t *last_next = (uint32_t *)get_payload_ptr(myheap_quick_base + last_offset);
+    uint64_t head = __atomic_load_n(list, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(last_next, QUICK_OFFSET(head), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(list, &head, QUICK_HEAD(first_offset, QUICK_TAG(head) + 1),
+                                          true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* 
+Function: push_transfer_batch
+Input: Pointer to a transfer cache head and an unsigned 32-bit integer
+Return Value: None
+========================================
+This function pushes the batch whose first block is at the given offset onto the given transfer cache. The batch's chain and 
+its last_block and num_blocks fields must already be set. 
+*/
+void push_transfer_batch(uint64_t *list, uint32_t first_offset) {
+    TransferBatch *batch = get_payload_ptr(myheap_quick_base + first_offset);
+    uint64_t head = __atomic_load_n(list, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&batch->next_batch, QUICK_OFFSET(head), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(list, &head, QUICK_HEAD(first_offset, QUICK_TAG(head) + 1),
+                                          true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* 
+Function: pop_transfer_batch
+Input: Pointer to a transfer cache head
+Return Value: Unsigned 32-bit integer
+========================================
+This function pops one batch from the given transfer cache and returns the offset of its first block, or QUICK_EMPTY if the 
+cache is empty. As in myheap_quick_pop, the version tag makes the compare-and-swap fail if the top batch was taken in between. 
+*/
+uint32_t pop_transfer_batch(uint64_t *list) {
+    uint64_t head = __atomic_load_n(list, __ATOMIC_ACQUIRE);
+    while (QUICK_OFFSET(head) != QUICK_EMPTY) {
+        TransferBatch *batch = get_payload_ptr(myheap_quick_base + QUICK_OFFSET(head));
+        uint32_t next_batch = __atomic_load_n(&batch->next_batch, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(list, &head, QUICK_HEAD(next_batch, QUICK_TAG(head) + 1),
+                                        true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            return QUICK_OFFSET(head);
+        }
+    }
+    return QUICK_EMPTY;
+}
+
+/* 
+Function: free_quick_chain
+Input: Unsigned 32-bit integer
+Return Value: None
+=========================
+This function frees a detached chain of cached blocks, starting at the given offset and ending at a block whose next offset is 
+QUICK_EMPTY, back into the heap. It takes each block's shard lock in turn, so the caller must not hold any shard lock. 
+*/
+void free_quick_chain(uint32_t offset) {
+    while (offset != QUICK_EMPTY) {
+        void *block = myheap_quick_base + offset;
+        offset = *(uint32_t *)get_payload_ptr(block);
+        Shard *shard = get_shard(block);
+        pthread_mutex_lock(&shard->lock);
+        free_block(block);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/* 
+Function: flush_quick_list
+Input: Pointer to a quick list head
+Return Value: Boolean
+=========================
+This function detaches the given quick list and frees its cached blocks back into the heap. The caller must not hold any shard 
+lock. It returns true if any block was flushed. 
+*/
+bool flush_quick_list(uint64_t *list) {
+    uint32_t first_offset = detach_quick_list(list);
+    free_quick_chain(first_offset);
+    return first_offset != QUICK_EMPTY;
+}
+
+/* 
+Function: flush_transfer_cache
+Input: Pointer to a transfer cache head
+Return Value: Boolean
+=========================
+This function detaches the given transfer cache and frees every block of every batch on it back into the heap. The caller must 
+not hold any shard lock. It returns true if any block was flushed. 
+*/
+bool flush_transfer_cache(uint64_t *list) {
+    uint32_t first_offset = detach_quick_list(list);
+    uint32_t offset = first_offset;
+    while (offset != QUICK_EMPTY) {
+        uint32_t next_batch = ((TransferBatch *)get_payload_ptr(myheap_quick_base + offset))->next_batch;
+        free_quick_chain(offset); // overwrites the batch fields
+        offset = next_batch;
+    }
+    return first_offset != QUICK_EMPTY;
+}
+
+/* 
+Function: flush_quick_lists
+Input: None
+Return Value: Boolean
+=========================
+This function flushes the quick lists of every slot and size class. The caller must not hold any shard lock. It returns true 
+if any block was flushed. 
+*/
+bool flush_quick_lists(void) {
+    bool flushed = false;
+
+    for (int slot = 0; slot < QUICK_NUM_SLOTS; slot++) {
+        for (int i = 0; i < QUICK_NUM_CLASSES; i++) {
+            if (flush_quick_list(&myheap_quick_heads[slot][i])) {
+                flushed = true;
+            }
+            __atomic_store_n(&myheap_quick_counts[slot][i], 0, __ATOMIC_RELAXED);
+        }
+    }
+    for (int i = 0; i < QUICK_NUM_CLASSES; i++) {
+        if (flush_transfer_cache(&quick_transfer_heads[i])) {
+            flushed = true;
+        }
+    }
+
+    return flushed;
+}
+
+/* 
+Function: report_corruption
+Input: String and void pointer
+Return Value: None
+=========================
+This function reports a problem found by the incremental checker and stops in the debugger. 
+*/
+void report_corruption(const char *problem, void *block) {
+    printf("Heap corruption: %s: %p\n", problem, block);
+    breakpoint();
+}
+
+/* 
+Function: check_next_block
+Input: Pointer to a Shard
+Return Value: None
+=========================
+This function checks the block at the shard's block cursor and moves the cursor to the next block, wrapping around to the start 
+of the shard. The block must have a sane payload that stays within the shard, and if it and the block after it are in the 
+same shard, the boundary bits of the next block must match it and they must not both be free. The shard's lock must be held. 
+*/
+void check_next_block(Shard *shard) {
+    unsigned char *block = shard->check_block != NULL ? shard->check_block : shard->start;
+    unsigned int payload = ((Header *)block)->payload;
+    unsigned char *next_block = block + HEADER_SIZE + payload;
+
+    if (payload < MIN_PAYLOAD_SIZE || payload % ALIGNMENT != 0 || next_block > (unsigned char *)shard->end) {
+        report_corruption("bad payload size", block);
+        shard->check_block = NULL;
+        return;
+    }
+    if (next_block < (unsigned char *)shard->end) {
+        unsigned int next_status = ((Header *)next_block)->status;
+        bool is_free = !is_allocated(block);
+        if (is_free && !(next_status & BLOCK_ALLOCATED)) {
+            report_corruption("adjacent free blocks", block);
+        }
+        if (is_free != ((next_status & BLOCK_PREV_FREE) != 0)) {
+            report_corruption("boundary tag does not match block", next_block);
+        }
+    }
+    shard->check_block = next_block < (unsigned char *)shard->end ? next_block : NULL;
+}
+
+/* 
+Function: check_next_link
+Input: Pointer to a Shard
+Return Value: None
+=========================
+This function checks the free block at the shard's link cursor and moves the cursor along the free list, wrapping around to its 
+start. The block must lie in the shard, be marked free, and be linked to by its neighbors in the list. The shard's lock must be 
+held. 
+*/
+void check_next_link(Shard *shard) {
+    Pointers *links = shard->check_link != NULL ? shard->check_link : shard->free_list_start;
+    if (links == NULL) { // empty free list
+        return;
+    }
+
+    unsigned char *block = get_link_block(links);
+    if (block < (unsigned char *)shard->start || block >= (unsigned char *)shard->end) {
+        report_corruption("free list block outside its shard", block);
+        shard->check_link = NULL;
+        return;
+    }
+    if (is_allocated(block)) {
+        report_corruption("allocated block on the free list", block);
+    }
+    if (get_links(block) != links || get_link_payload(links) != ((Header *)block)->payload) {
+        report_corruption("free list links do not match block", block);
+    }
+    Pointers *previous = links->previous;
+    Pointers *next = links->next;
+    if (previous == NULL ? shard->free_list_start != links : previous->next != links) {
+        report_corruption("free list previous link broken", block);
+    }
+    if (next != NULL && next->previous != links) {
+        report_corruption("free list next link broken", block);
+    }
+    shard->check_link = next;
+}
+
+/* 
+Function: check_shard
+Input: Pointer to a Shard
+Return Value: None
+=========================
+This function does the incremental checker's share of work for one operation on the given shard: check_per_op blocks and 
+check_per_op free list links. The shard's lock must be held. 
+*/
+void check_shard(Shard *shard) {
+    for (size_t i = 0; i < check_per_op; i++) {
+        check_next_block(shard);
+        check_next_link(shard);
+    }
+}
+
+/* 
+Function: find_fit_in_shards
+Input: size_t number and a fit function
+Return Value: Void pointer
+==================================
+This function runs the given fit function (find_fit or find_fit_high) on each shard in turn, starting with the calling thread's home 
+shard, until one of them returns a block. Each shard is locked only while it is searched, so the caller must not hold any shard lock. 
+It returns a pointer to the allocated block, or NULL if no shard has a suitable block. 
+*/
+void *find_fit_in_shards(size_t aligned_requested_size, void *(*fit)(Shard *, size_t)) {
+    size_t home = get_home_shard();
+
+    for (size_t i = 0; i < num_shards; i++) {
+        Shard *shard = &shards[(home + i) % num_shards];
+        pthread_mutex_lock(&shard->lock);
+        void *block = fit(shard, aligned_requested_size);
+        if (block != NULL) {
+            check_shard(shard);
+        }
+        pthread_mutex_unlock(&shard->lock);
+        if (block != NULL) {
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+/* 
+Function: drain_async_ring
+Input: Pointer to an AsyncRing
+Return Value: Size_t number
+=============================
+This function frees every pointer queued on the given ring. Consecutive pointers that belong to the same shard are freed 
+under a single acquisition of its lock. async_drain_lock must be held. It returns the number of pointers freed. 
+*/
+size_t drain_async_ring(AsyncRing *ring) {
+    uint32_t head = ring->head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    Shard *locked_shard = NULL;
+
+    for (uint32_t i = head; i != tail; i++) {
+        void *block = (unsigned char *)ring->slots[i & (ASYNC_RING_SIZE - 1)] - HEADER_SIZE;
+        Shard *shard = get_shard(block);
+        if (shard != locked_shard) {
+            if (locked_shard != NULL) {
+                pthread_mutex_unlock(&locked_shard->lock);
+            }
+            pthread_mutex_lock(&shard->lock);
+            locked_shard = shard;
+        }
+        free_block(block);
+    }
+    if (locked_shard != NULL) {
+        pthread_mutex_unlock(&locked_shard->lock);
+    }
+
+    __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE); // hands the drained slots back to the producer
+    return tail - head;
+}
+
+/* 
+Function: drain_async_rings
+Input: None
+Return Value: Size_t number
+=============================
+This function drains every claimed ring and returns the total number of pointers freed. 
+*/
+size_t drain_async_rings(void) {
+    size_t freed = 0;
+    unsigned int claimed = __atomic_load_n(&num_async_rings, __ATOMIC_ACQUIRE);
+    if (claimed > ASYNC_MAX_RINGS) {
+        claimed = ASYNC_MAX_RINGS;
+    }
+
+    pthread_mutex_lock(&async_drain_lock);
+    for (unsigned int i = 0; i < claimed; i++) {
+        freed += drain_async_ring(&async_rings[i]);
+    }
+    pthread_mutex_unlock(&async_drain_lock);
+    return freed;
+}
+
+/* 
+Function: run_reclaimers
+Input: size_t number
+Return Value: Boolean
+=========================
+This function asks every registered reclaimer to free the given number of bytes. The table is copied under its lock, and the 
+callbacks run with no lock held. It does nothing if called from inside a reclaimer. It returns true if any reclaimer reported 
+freeing memory. 
+*/
+bool run_reclaimers(size_t bytes_wanted) {
+    if (in_reclaim) {
+        return false;
+    }
+
+    Reclaimer to_run[MYHEAP_MAX_RECLAIMERS];
+    pthread_mutex_lock(&reclaimer_lock);
+    size_t count = num_reclaimers;
+    memcpy(to_run, reclaimers, count * sizeof(Reclaimer));
+    pthread_mutex_unlock(&reclaimer_lock);
+
+    size_t freed = 0;
+    in_reclaim = true;
+    for (size_t i = 0; i < count; i++) {
+        freed += to_run[i].fn(bytes_wanted, to_run[i].arg);
+    }
+    in_reclaim = false;
+    return freed > 0;
+}
+
+/* 
+Function: admit_allocation
+Input: size_t number
+Return Value: Boolean
+=========================
+This function checks an allocation of the given total size (headers included) against the hard limit, running the reclaimers once 
+if it would exceed it. It returns false if the allocation must fail. 
+*/
+bool admit_allocation(size_t bytes) {
+    size_t limit = __atomic_load_n(&hard_limit, __ATOMIC_RELAXED);
+    if (limit == 0) {
+        return true;
+    }
+
+    size_t usage = myheap_usage();
+    if (usage + bytes <= limit) {
+        return true;
+    }
+    run_reclaimers(usage + bytes - limit);
+    return myheap_usage() + bytes <= limit;
+}
+
+/* 
+Function: check_soft_limit
+Input: None
+Return Value: None
+====================
+This function is called after every successful allocation. The first time usage is found above the soft limit it runs the 
+reclaimers, asking for the excess. They run again only after a later check has found usage back under the limit. 
+*/
+void check_soft_limit(void) {
+    size_t limit = __atomic_load_n(&soft_limit, __ATOMIC_RELAXED);
+    if (limit == 0) {
+        return;
+    }
+
+    size_t usage = myheap_usage();
+    if (usage <= limit) {
+        __atomic_store_n(&soft_limit_crossed, false, __ATOMIC_RELAXED);
+    } else if (!__atomic_exchange_n(&soft_limit_crossed, true, __ATOMIC_RELAXED)) {
+        run_reclaimers(usage - limit);
+    }
+}
+
+/* 
+Function: fits_largest_shard
+Input: size_t number
+Return Value: Boolean
+======================
+This function returns true if a block with the given payload size could fit in the largest shard of the main heap. 
+*/
+bool fits_largest_shard(size_t aligned_requested_size) {
+    Shard *last_shard = &shards[num_shards - 1]; // the largest, it also takes the remainder of the segment
+    return aligned_requested_size <= (size_t)(myheap_reserve_start - (unsigned char *)last_shard->start) - HEADER_SIZE;
+}
+
+/* 
+Function: find_fit_admitted
+Input: size_t number and a fit function
+Return Value: Void pointer
+======================
+This function runs find_fit_in_shards for a request the hard limit has already admitted. If no block fits, it first drains the 
+async free rings, then flushes the quick lists so that the cached blocks can coalesce, and then runs the reclaimers, searching 
+again after each step that released memory. It also flushes the quick lists after a shard has switched to best fit. The caller 
+must not hold any shard lock. 
+*/
+void *find_fit_admitted(size_t aligned_requested_size, void *(*fit)(Shard *, size_t)) {
+    void *block = find_fit_in_shards(aligned_requested_size, fit);
+    if (block == NULL && drain_async_rings() > 0) { // frees queued by myfree_async may not have been drained yet
+        block = find_fit_in_shards(aligned_requested_size, fit);
+    }
+    if (block == NULL && flush_quick_lists()) { // cached small blocks may coalesce into a fit
+        block = find_fit_in_shards(aligned_requested_size, fit);
+    }
+    if (block == NULL && run_reclaimers(aligned_requested_size + HEADER_SIZE)) {
+        block = find_fit_in_shards(aligned_requested_size, fit);
+    }
+
+    if (block != NULL) {
+        check_soft_limit();
+    }
+    if (__atomic_load_n(&quick_flush_wanted, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&quick_flush_wanted, false, __ATOMIC_RELAXED)) {
+        flush_quick_lists();
+    }
+    return block;
+}
+
+/* 
+Function: find_fit_or_reclaim
+Input: size_t number and a fit function
+Return Value: Void pointer
+======================
+This function is the search used by the allocation paths. A request larger than the largest shard fails at once, and one the hard 
+limit refuses fails after the reclaimers have run. Otherwise it returns the result of find_fit_admitted. The caller must not hold 
+any shard lock. 
+*/
+void *find_fit_or_reclaim(size_t aligned_requested_size, void *(*fit)(Shard *, size_t)) {
+    if (!fits_largest_shard(aligned_requested_size) || !admit_allocation(aligned_requested_size + HEADER_SIZE)) {
+        return NULL;
+    }
+    return find_fit_admitted(aligned_requested_size, fit);
+}
+
+/* 
+Function: resize_in_place
+Input: Void pointer and a size_t number
+Return Value: Boolean
+==========================================
+This function attempts the in-place part of myrealloc. It shrinks the given block, or grows it by coalescing with free blocks 
+to its right, and returns true if the block now holds the new payload size. If it returns false, the block may have grown but 
+is still too small and must be moved. The lock of the block's shard must be held. 
+*/
+bool resize_in_place(void *old_block_ptr, size_t new_aligned_size) {
+    size_t old_payload_size = ((Header *)old_block_ptr)->payload;
+    size_t min_split = new_aligned_size + SPLIT_THRESHOLD;
+
+    if (old_payload_size == new_aligned_size) { // don't need to do anything
+        return true;
+    }
+    if (old_payload_size > new_aligned_size && old_payload_size < min_split) { // bigger than needed, but not big enough to split 
+        return true;
+    }
+    if (old_payload_size > new_aligned_size && old_payload_size >= min_split) { // split current block
+        partition(old_block_ptr, old_payload_size, new_aligned_size);
+        
+        return true;
+    }
+
+    coalesce_right(old_block_ptr);
+    unsigned int new_payload_size = ((Header *)old_block_ptr)->payload;
+    if (new_payload_size >= new_aligned_size) { // check if realloc in place is possible
+        if (new_payload_size >= min_split) {
+            partition(old_block_ptr, ((Header *)old_block_ptr)->payload, new_aligned_size);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+/* 
+Function: touch_pages
+Input: Void pointer and two size_t numbers
+Return Value: None
+==========================================
+This function writes to every page between the given start and end offsets from the given base, with an atomic add of zero, so 
+the pages are faulted in without their contents changing. 
+*/
+void touch_pages(void *base, size_t start, size_t end) {
+    // one byte every PAGE_SIZE bytes lands on every page exactly once, even if the segment is not page aligned
+    for (size_t offset = start; offset < end; offset += PAGE_SIZE) {
+        __atomic_fetch_add((unsigned char *)base + offset, 0, __ATOMIC_RELAXED);
+    }
+}
+
+
+/* ---------------------
+ * MAIN HEAP FUNCTIONS
+ * ---------------------
+ */
+
+/* 
+Function: myinit
+Input: Void pointer and size_t number
+Output: Boolean
+=======================================
+This function initializes the allocator with the given heap segment parameters as along as at least one valid request can be serviced. If the 
+allocator is successfully initialized, true is returned. Otherwise, false is returned
+*/
+bool myinit(void *heap_start, size_t heap_size) {
+    return myinit_opts(heap_start, heap_size, NULL);
+}
+
+/* 
+Function: myinit_opts
+Input: Void pointer, size_t number, and pointer to MyHeapOptions
+Output: Boolean
+=======================================
+This function is myinit with the optional features requested in the given options turned on. Passing NULL options is the same as 
+calling myinit. It splits the segment into the requested number of shards, plus the reserve shard if one was requested, each 
+starting out as a single free block. If the segment is too small for every shard to hold a block, or for every shard to hold a 
+block of max_request_size, or lock_pages is set and the segment cannot be locked, false is returned and the allocator is left as 
+it was. 
+*/
+bool myinit_opts(void *heap_start, size_t heap_size, const MyHeapOptions *opts) {
+    size_t requested_shards = opts != NULL && opts->num_shards > 1 ? opts->num_shards : 1;
+    size_t reserve_size = opts != NULL ? align(opts->reserve_size, ALIGNMENT) : 0;
+    size_t table_slots = opts != NULL ? opts->side_link_slots : 0;
+    size_t table_bytes = table_slots * sizeof(SideLinks);
+    if (table_slots >= (1u << (32 - LINK_SLOT_SHIFT)) || table_bytes + reserve_size > heap_size) {
+        return false;
+    }
+    size_t main_size = heap_size - table_bytes - reserve_size;
+    if (main_size <= HEADER_SIZE || requested_shards + (reserve_size > 0) > MAX_SHARDS) {
+        return false;
+    }
+    if (reserve_size > 0 && reserve_size < MIN_BLOCK_SIZE) {
+        return false;
+    }
+    if (requested_shards > 1 && main_size / requested_shards < MIN_BLOCK_SIZE + ALIGNMENT) {
+        return false;
+    }
+    size_t smallest_shard = requested_shards > 1 ? main_size / requested_shards / ALIGNMENT * ALIGNMENT : main_size;
+    if (opts != NULL && opts->max_request_size > 0 && get_aligned_size(opts->max_request_size) > smallest_shard - HEADER_SIZE) {
+        return false;
+    }
+    // the steps that can fail come before any state changes, so a failed init leaves the current heap usable
+    if (opts != NULL && opts->lock_pages && mlock(heap_start, heap_size) != 0) {
+        return false;
+    }
+    if (opts != NULL && opts->prefault) {
+        touch_pages(heap_start, 0, heap_size);
+    }
+
+    segment_start = heap_start;
+    segment_end = (unsigned char *)heap_start + heap_size - table_bytes;
+    segment_size = heap_size - table_bytes;
+    side_table = table_slots > 0 ? (SideLinks *)segment_end : NULL;
+    side_table_bytes = table_bytes;
+    myheap_reserve_start = (unsigned char *)heap_start + main_size;
+    num_shards = requested_shards;
+    num_reserve_shards = reserve_size > 0 ? 1 : 0;
+    shard_size = num_shards > 1 ? main_size / num_shards / ALIGNMENT * ALIGNMENT : main_size;
+    myheap_set_limits(opts != NULL ? opts->soft_limit : 0, opts != NULL ? opts->hard_limit : 0);
+    __atomic_store_n(&warm_offset, opts != NULL && opts->prefault ? heap_size : 0, __ATOMIC_RELAXED); // prefault touched it all
+    memset(tag_bytes, 0, sizeof(tag_bytes));
+    check_per_op = opts != NULL ? opts->check_per_op : 0;
+    adaptive = opts != NULL && opts->adaptive;
+    quick_flush_wanted = false;
+    last_hot_ptr = NULL;
+
+    for (size_t i = 0; i < num_shards + num_reserve_shards; i++) {
+        Shard *shard = &shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->start = (unsigned char *)heap_start + i * shard_size;
+        shard->end = i == num_shards - 1 ? myheap_reserve_start : (unsigned char *)shard->start + shard_size;
+        if (i == num_shards) { // the reserve
+            shard->start = myheap_reserve_start;
+            shard->end = segment_end;
+        }
+        shard->free_list_start = NULL;
+        shard->free_bytes = 0;
+        shard->check_block = NULL;
+        shard->check_link = NULL;
+        shard->fit_policy = MYHEAP_FIT_POLICY;
+        shard->window_fits = 0;
+
+        // chain the shard's share of the side table
+        size_t first_slot = table_slots * i / (num_shards + num_reserve_shards);
+        size_t last_slot = table_slots * (i + 1) / (num_shards + num_reserve_shards);
+        shard->free_slots = NULL;
+        for (size_t slot = last_slot; slot > first_slot; slot--) {
+            side_table[slot - 1].links.next = shard->free_slots;
+            shard->free_slots = &side_table[slot - 1].links;
+        }
+
+        // set up the shard's first block
+        unsigned int payload = (unsigned char *)shard->end - (unsigned char *)shard->start - HEADER_SIZE;
+        ((Header *)shard->start)->payload = payload;
+        ((Header *)shard->start)->status = BLOCK_ALLOCATED;
+        add_block(shard->start);
+    }
+
+    myheap_quick_base = heap_start;
+    for (int slot = 0; slot < QUICK_NUM_SLOTS; slot++) {
+        for (int i = 0; i < QUICK_NUM_CLASSES; i++) {
+            myheap_quick_heads[slot][i] = QUICK_HEAD(QUICK_EMPTY, 0);
+            myheap_quick_counts[slot][i] = 0;
+        }
+    }
+    for (int i = 0; i < QUICK_NUM_CLASSES; i++) {
+        quick_transfer_heads[i] = QUICK_HEAD(QUICK_EMPTY, 0);
+    }
+
+    // pointers still queued belong to the previous segment
+    pthread_mutex_lock(&async_drain_lock);
+    for (size_t i = 0; i < ASYNC_MAX_RINGS; i++) {
+        async_rings[i].head = __atomic_load_n(&async_rings[i].tail, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(&async_drain_lock);
+
+    return true;  
+}
+
+
+/* 
+Function: mymalloc
+Input: Size_t number
+Return Value: Void Pointer
+========================
+This function takes in a requested payload size and finds and returns an unallocated block of memory that is sufficiently large to hold 
+the payload, or null if no such block can be found. The returned pointer points to the start of the payload space, not the header.
+*/
+void *mymalloc(size_t requested_size) {
+    PROBE1(malloc_entry, requested_size);
+    if (requested_size > MAX_REQUEST_SIZE || requested_size == 0) {
+        PROBE2(malloc_return, NULL, requested_size);
+        return NULL;
+    }
+
+    size_t aligned_requested_size = get_aligned_size(requested_size);
+    
+    void *block = find_fit_or_reclaim(aligned_requested_size, find_fit);
+    if (block != NULL) {
+        PROBE2(malloc_return, get_payload_ptr(block), requested_size);
+        return get_payload_ptr(block); // return a pointer to the start of the payload space
+    } else {
+        PROBE2(malloc_return, NULL, requested_size);
+        return NULL;
+    }
+}
+
+/* 
+Function: mymalloc_flags
+Input: Size_t number and unsigned integer
+Return Value: Void Pointer
+==================================
+This function behaves like mymalloc, but takes a set of MYMALLOC_* hints describing the expected lifetime and temperature of the 
+object. Long-lived or cold objects are placed at the high end of the segment so they pack densely away from short-lived churn. 
+Hot objects are placed near the previous hot object, short-lived objects in the lowest block that fits, and unhinted objects take 
+the normal first-fit path. Critical objects are taken from the reserve when it has room. 
+*/
+void *mymalloc_flags(size_t requested_size, unsigned int flags) {
+    if (requested_size > MAX_REQUEST_SIZE || requested_size == 0) {
+        return NULL;
+    }
+
+    size_t aligned_requested_size = get_aligned_size(requested_size);
+
+    void *block = NULL;
+    if ((flags & MYMALLOC_CRITICAL) && num_reserve_shards > 0) {
+        Shard *reserve = &shards[num_shards];
+        pthread_mutex_lock(&reserve->lock);
+        block = find_fit(reserve, aligned_requested_size);
+        if (block != NULL) {
+            check_shard(reserve);
+        }
+        pthread_mutex_unlock(&reserve->lock);
+    }
+    if (block != NULL) {
+        return get_payload_ptr(block);
+    }
+
+    if (flags & (MYMALLOC_LONG_LIVED | MYMALLOC_COLD)) {
+        block = find_fit_or_reclaim(aligned_requested_size, find_fit_high);
+    } else if (flags & MYMALLOC_HOT) {
+        void *ptr = mymalloc_near(__atomic_load_n(&last_hot_ptr, __ATOMIC_RELAXED), requested_size);
+        if (ptr != NULL) {
+            __atomic_store_n(&last_hot_ptr, ptr, __ATOMIC_RELAXED);
+        }
+        return ptr;
+    } else if (flags & MYMALLOC_SHORT_LIVED) {
+        block = find_fit_or_reclaim(aligned_requested_size, find_fit_low);
+    } else {
+        block = find_fit_or_reclaim(aligned_requested_size, find_fit);
+    }
+
+    if (block != NULL) {
+        return get_payload_ptr(block);
+    } else {
+        return NULL;
+    }
+}
+
+/* 
+Function: mymalloc_near
+Input: Void pointer and size_t number
+Return Value: Void Pointer
+==================================
+This function behaves like mymalloc, but tries to place the new payload on the same page, or failing that the same huge page, as 
+the given payload pointer. If the pointer is NULL or no block in its shard is suitable, it falls back to an ordinary first-fit 
+allocation. The request is admitted against the hard limit once, before either search. 
+*/
+void *mymalloc_near(void *near_ptr, size_t requested_size) {
+    if (requested_size > MAX_REQUEST_SIZE || requested_size == 0) {
+        return NULL;
+    }
+
+    size_t aligned_requested_size = get_aligned_size(requested_size);
+
+    void *block = NULL;
+    if (!fits_largest_shard(aligned_requested_size) || !admit_allocation(aligned_requested_size + HEADER_SIZE)) {
+        return NULL;
+    }
+    if (near_ptr != NULL && near_ptr > segment_start && (unsigned char *)near_ptr < myheap_reserve_start) {
+        void *near_block = (unsigned char *)near_ptr - HEADER_SIZE;
+        Shard *shard = get_shard(near_block);
+        pthread_mutex_lock(&shard->lock);
+        block = find_fit_near(near_block, aligned_requested_size);
+        if (block != NULL) {
+            check_shard(shard);
+        }
+        pthread_mutex_unlock(&shard->lock);
+    }
+    if (block == NULL) {
+        block = find_fit_admitted(aligned_requested_size, find_fit);
+    } else {
+        check_soft_limit();
+    }
+
+    if (block != NULL) {
+        return get_payload_ptr(block);
+    } else {
+        return NULL;
+    }
+}
+
+/* 
+Function: mymalloc_tagged
+Input: Size_t number and unsigned integer
+Return Value: Void Pointer
+==================================
+This function behaves like mymalloc, but charges the payload to the given tag until it is freed. Tag 0 is the same as mymalloc. 
+NULL is returned for tags of MYHEAP_MAX_TAGS or more. 
+*/
+void *mymalloc_tagged(size_t requested_size, unsigned int tag) {
+    if (tag >= MYHEAP_MAX_TAGS) {
+        return NULL;
+    }
+
+    void *ptr = mymalloc(requested_size);
+    if (ptr != NULL && tag != 0) {
+        set_tag((unsigned char *)ptr - HEADER_SIZE, tag);
+    }
+    return ptr;
+}
+
+/* 
+Function: myheap_tag_bytes
+Input: Unsigned integer
+Return Value: Size_t number
+==================================
+This function returns the number of payload bytes currently allocated under the given tag, or 0 for an invalid tag. 
+*/
+size_t myheap_tag_bytes(unsigned int tag) {
+    if (tag == 0 || tag >= MYHEAP_MAX_TAGS) {
+        return 0;
+    }
+    return __atomic_load_n(&tag_bytes[tag], __ATOMIC_RELAXED);
+}
+
+/* 
+Function: mymalloc_cacheline
+Input: Size_t number
+Return Value: Void Pointer
+==================================
+This function behaves like mymalloc, but the payload starts on a cache line boundary and is rounded up to a whole number of 
+cache lines, so no other object shares a line with it. 
+*/
+void *mymalloc_cacheline(size_t requested_size) {
+    if (requested_size > MAX_REQUEST_SIZE || requested_size == 0) {
+        return NULL;
+    }
+
+    size_t aligned_requested_size = align(requested_size, CACHE_LINE_SIZE);
+
+    void *block = find_fit_or_reclaim(aligned_requested_size, find_fit_cacheline);
+    if (block != NULL) {
+        return get_payload_ptr(block);
+    } else {
+        return NULL;
+    }
+}
+
+/* 
+Function: myfree 
+Input: Void pointer
+Return Value: None
+====================
+This function marks the given block as available for allocation by adding it to the list of
+free blocks. Before adding to the list of free blocks, myfree also checks if the given block can be 
+coalesced with neighboring blocks to the right. Finally, it updates the block's header to reflect its deallocation. 
+ */
+void myfree(void *ptr) {
+    PROBE1(free, ptr);
+    if (ptr != NULL) {
+        void *block_ptr = (unsigned char *)ptr - HEADER_SIZE;
+        // coalesce then add to free list
+        Shard *shard = get_shard(block_ptr);
+        pthread_mutex_lock(&shard->lock);
+        free_block(block_ptr);
+        check_shard(shard);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+/*
+Function: myrealloc 
+Input: Void pointer and a size_t number
+Return Value: Void pointer
+==========================================
+This function reallocs existing memory. Given a pointer to the payload to be reallocated and a new size, the function 
+first attempts to reallocate in place if the given block is sufficiently large or can be expanded/contracted to 
+accomodate the new size. If in-place realloc is not possible, it mallocs a new block. It returns a pointer to the "new" 
+payload space. Growing is checked against the hard limit first, whether it happens in place or by moving. 
+ */
+void *myrealloc(void *old_ptr, size_t new_size) {
+    PROBE2(realloc_entry, old_ptr, new_size);
+    if (old_ptr == NULL || new_size == 0) { // handling of edge cases
+        return mymalloc(new_size);
+    }
+    if (new_size > MAX_REQUEST_SIZE) {
+        PROBE2(realloc_return, NULL, new_size);
+        return NULL;
+    }
+
+    void *old_block_ptr = (unsigned char *)old_ptr - HEADER_SIZE;
+    size_t old_payload_size = ((Header *)old_block_ptr)->payload;
+    size_t new_aligned_size = get_aligned_size(new_size);
+    bool growing = new_aligned_size > old_payload_size;
+    if (growing && !admit_allocation(new_aligned_size - old_payload_size)) {
+        PROBE2(realloc_return, NULL, new_size);
+        return NULL;
+    }
+
+    Shard *shard = get_shard(old_block_ptr);
+    pthread_mutex_lock(&shard->lock);
+    bool resized = resize_in_place(old_block_ptr, new_aligned_size);
+    adjust_tag_bytes(old_block_ptr, (long)((Header *)old_block_ptr)->payload - (long)old_payload_size);
+    unsigned int tag = ((Header *)old_block_ptr)->status >> BLOCK_TAG_SHIFT;
+    check_shard(shard);
+    pthread_mutex_unlock(&shard->lock);
+    if (resized) {
+        if (growing) {
+            check_soft_limit();
+        }
+        PROBE2(realloc_return, old_ptr, new_size);
+        return old_ptr;
+    }
+
+    // the old block is still allocated to us, so it is safe to move it without holding its shard lock
+    void *realloc_block = find_fit_or_reclaim(new_aligned_size, find_fit);
+    if (realloc_block != NULL) {
+        if (tag != 0) {
+            set_tag(realloc_block, tag);
+        }
+        memcpy(get_payload_ptr(realloc_block), old_ptr, old_payload_size);
+        myfree(old_ptr);
+        PROBE2(realloc_return, get_payload_ptr(realloc_block), new_size);
+        return get_payload_ptr(realloc_block);
+    }
+
+    PROBE2(realloc_return, NULL, new_size);
+    return NULL;
+}
+
+
+
+/* ---------------------
+ * FAST PATH FUNCTIONS
+ * ---------------------
+ */
+
+/* 
+Function: mymalloc_quick_refill
+Input: Size_t number
+Return Value: Void Pointer
+==================================
+This function is the out-of-line slow path of mymalloc_small, called when the quick list for the request's size class is empty. 
+It first tries to steal one batch from the class's transfer cache, returning its first block and caching the rest. Otherwise it 
+finds one free block large enough for a batch of blocks of the class size, starting on a cache line boundary and rounded up to 
+whole cache lines, and carves it into QUICK_REFILL_BATCH allocated blocks. The last block is returned to the caller (keeping any 
+slack that was too small to split off) and the rest are pushed on the quick list. If no batch fits, a single block is allocated 
+with mymalloc instead.
+*/
+void *mymalloc_quick_refill(size_t requested_size) {
+    if (requested_size == 0 || requested_size > QUICK_MAX_PAYLOAD) {
+        return mymalloc(requested_size);
+    }
+
+    unsigned int slot = myheap_quick_slot();
+    size_t size_class = QUICK_CLASS(requested_size);
+    uint32_t stolen = pop_transfer_batch(&quick_transfer_heads[size_class]);
+    if (stolen != QUICK_EMPTY) {
+        TransferBatch *batch = get_payload_ptr(myheap_quick_base + stolen);
+        if (batch->num_blocks > 1) {
+            push_quick_chain(&myheap_quick_heads[slot][size_class], batch->next_block, batch->last_block);
+            __atomic_fetch_add(&myheap_quick_counts[slot][size_class], batch->num_blocks - 1, __ATOMIC_RELAXED);
+        }
+        return batch;
+    }
+
+    size_t aligned_requested_size = get_aligned_size(requested_size);
+    size_t block_size = aligned_requested_size + HEADER_SIZE;
+    size_t batch_size = align(QUICK_REFILL_BATCH * block_size, CACHE_LINE_SIZE); // whole lines, so no other run shares one
+    if (!admit_allocation(batch_size)) { // a single block may still fit under the hard limit
+        return mymalloc(requested_size);
+    }
+    size_t home = get_home_shard();
+    Shard *shard = NULL;
+    void *batch = NULL;
+    for (size_t i = 0; i < num_shards && batch == NULL; i++) {
+        shard = &shards[(home + i) % num_shards];
+        pthread_mutex_lock(&shard->lock);
+        batch = find_fit_aligned(shard, batch_size - HEADER_SIZE, HEADER_SIZE);
+        if (batch == NULL) {
+            pthread_mutex_unlock(&shard->lock);
+        }
+    }
+    if (batch == NULL) {
+        return mymalloc(requested_size);
+    }
 
-// 8-byte struct to hold block header
-typedef struct Header {
-    unsigned int payload;
-    int allocated;
-} Header;
+    // carve under the lock, since coalescing neighbors read the batch's headers
+    size_t batch_end = (size_t)((Header *)batch)->payload + HEADER_SIZE;
+    unsigned int prev_bits = ((Header *)batch)->status & (BLOCK_PREV_FREE | BLOCK_PREV_MIN); // leading space may be free
+    unsigned char *curr_block = batch;
+    for (int i = 0; i < QUICK_REFILL_BATCH - 1; i++) {
+        ((Header *)curr_block)->payload = aligned_requested_size;
+        ((Header *)curr_block)->status = BLOCK_ALLOCATED | prev_bits;
+        myheap_quick_push(&myheap_quick_heads[slot][size_class], curr_block);
+        curr_block += block_size;
+        prev_bits = 0; // only the first block of the batch has a neighbor that may be free
+    }
+    __atomic_fetch_add(&myheap_quick_counts[slot][size_class], QUICK_REFILL_BATCH - 1, __ATOMIC_RELAXED);
+
+    // last block takes whatever remains of the batch
+    ((Header *)curr_block)->payload = batch_end - (QUICK_REFILL_BATCH - 1) * block_size - HEADER_SIZE;
+    ((Header *)curr_block)->status = BLOCK_ALLOCATED | prev_bits;
+    check_shard(shard);
+    pthread_mutex_unlock(&shard->lock);
+    check_soft_limit();
+    return get_payload_ptr(curr_block);
+}
 
+/* 
+Function: myheap_quick_assign_slot
+Input: None
+Return Value: Unsigned integer
+=================================
+This function is called the first time a thread needs a quick list slot. It hands out slots round robin and remembers the 
+calling thread's slot so that later lookups are a single thread-local load. 
+*/
+unsigned int myheap_quick_assign_slot(void) {
+    unsigned int slot = __atomic_fetch_add(&next_quick_slot, 1, __ATOMIC_RELAXED) % QUICK_NUM_SLOTS;
+    myheap_quick_thread_slot = slot + 1;
+    return slot;
+}
 
-/* ----------------
- * UTILITIES
- * ----------------
- */
+/* 
+Function: myheap_quick_donate
+Input: Unsigned integer and size_t number
+Return Value: None
+=====================================
+This function is called by myfree_small when a quick list has grown to QUICK_MAX_CACHED blocks. It detaches the whole list, 
+cuts it into batches of at most QUICK_TRANSFER_BATCH blocks, and pushes each onto the size class's shared transfer cache, where 
+a slot that is allocating rather than freeing will steal one per refill. The walk is bounded by the length of the list. 
+*/
+void myheap_quick_donate(unsigned int slot, size_t size_class) {
+    uint32_t offset = detach_quick_list(&myheap_quick_heads[slot][size_class]);
+    __atomic_store_n(&myheap_quick_counts[slot][size_class], 0, __ATOMIC_RELAXED);
+
+    while (offset != QUICK_EMPTY) {
+        uint32_t first_offset = offset;
+        uint32_t last_offset = offset;
+        uint32_t num_blocks = 0;
+        while (offset != QUICK_EMPTY && num_blocks < QUICK_TRANSFER_BATCH) {
+            last_offset = offset;
+            offset = *(uint32_t *)get_payload_ptr(myheap_quick_base + offset);
+            num_blocks++;
+        }
+        *(uint32_t *)get_payload_ptr(myheap_quick_base + last_offset) = QUICK_EMPTY; // cut the batch off the rest
+        TransferBatch *batch = get_payload_ptr(myheap_quick_base + first_offset);
+        batch->last_block = last_offset;
+        batch->num_blocks = num_blocks;
+        push_transfer_batch(&quick_transfer_heads[size_class], first_offset);
+    }
+}
 
 /* 
-Function: align
-Input: size_t number and size_t number
-Output: size_t number
-========================================
-This function rounds the given number "size" to be a multiple of "mult" 
+Function: myheap_quick_flush
+Input: None
+Return Value: Boolean
+=========================
+This function empties every quick list, freeing the cached blocks back into the heap so that they can be coalesced and reused 
+by allocations of any size. It returns true if any block was flushed. 
 */
-size_t align(size_t size, size_t mult) {
-    return (size + (mult - 1)) & ~(mult - 1);
+bool myheap_quick_flush(void) {
+    return flush_quick_lists();
 }
 
+
+/* ---------------------
+ * PREFAULT FUNCTIONS
+ * ---------------------
+ */
+
 /* 
-Function: get_payload_ptr
-Input: Void Pointer
-Return Value: Void Pointer
+Function: myheap_warm
+Input: size_t number
+Return Value: size_t number
 =============================
-Given a pointer to the start/header of a block, this function returns a pointer to the start of the payload 
-for that block 
+This function claims the next pages of the segment that have not been warmed, covering at least the given number of bytes, and 
+writes to each of them so they are faulted in before an allocation reaches them. Each page is touched by exactly one caller even 
+when several threads warm at once. It returns the number of bytes claimed, which is 0 once the whole segment is warm. 
 */
-void *get_payload_ptr(void *block) {
-    return (unsigned char *)block + HEADER_SIZE;
+size_t myheap_warm(size_t bytes) {
+    size_t claim = align(bytes, PAGE_SIZE);
+    size_t start = __atomic_fetch_add(&warm_offset, claim, __ATOMIC_RELAXED);
+    size_t warm_size = segment_size + side_table_bytes;
+    if (start >= warm_size) {
+        return 0;
+    }
+    size_t end = start + claim < warm_size ? start + claim : warm_size;
+    touch_pages(segment_start, start, end);
+    return end - start;
 }
 
-
-/* --------------------------
- * FREE BLOCK LIST FUNCTIONS
- * --------------------------
+/* ---------------------
+ * MEMORY PRESSURE FUNCTIONS
+ * ---------------------
  */
 
 /* 
-Function: add_block
-Input: Void pointer
-Return Value: None
+Function: myheap_register_reclaimer
+Input: Reclaimer callback and void pointer
+Return Value: Boolean
 =========================
-Adds the given block to the front of the free list and does any necessary list and header maintenance 
+This function registers a callback that is asked to free memory, with the given argument, whenever the heap is under pressure. 
+It returns false if MYHEAP_MAX_RECLAIMERS callbacks are already registered. 
 */
-void add_block(void *block) {
-    if (free_list_start == NULL) { // free list is empty
-        ((Pointers *)get_payload_ptr(block))->previous = NULL;
-        ((Pointers *)get_payload_ptr(block))->next = NULL;
-    } else {
-        ((Pointers *)get_payload_ptr(free_list_start))->previous = block;
-        ((Pointers *)get_payload_ptr(block))->next = free_list_start;
-        ((Pointers *)get_payload_ptr(block))->previous = NULL;
+bool myheap_register_reclaimer(myheap_reclaimer reclaimer, void *arg) {
+    if (reclaimer == NULL) {
+        return false;
     }
 
-    ((Header *)block)->allocated = 0;
-    free_list_start = block;
+    pthread_mutex_lock(&reclaimer_lock);
+    bool registered = num_reclaimers < MYHEAP_MAX_RECLAIMERS;
+    if (registered) {
+        reclaimers[num_reclaimers].fn = reclaimer;
+        reclaimers[num_reclaimers].arg = arg;
+        num_reclaimers++;
+    }
+    pthread_mutex_unlock(&reclaimer_lock);
+    return registered;
 }
 
 /* 
-Function: remove_block
-Input: Void pointer
+Function: myheap_set_limits
+Input: size_t number and size_t number
 Return Value: None
-=======================
-This function removes the given block from the free list 
+=========================
+This function replaces the soft and hard usage limits. A limit of 0 turns it off. 
 */
-void remove_block(void *block) {
-    void *previous = ((Pointers *)get_payload_ptr(block))->previous;
-    void *next = ((Pointers *)get_payload_ptr(block))->next;
+void myheap_set_limits(size_t new_soft_limit, size_t new_hard_limit) {
+    __atomic_store_n(&soft_limit, new_soft_limit, __ATOMIC_RELAXED);
+    __atomic_store_n(&hard_limit, new_hard_limit, __ATOMIC_RELAXED);
+    __atomic_store_n(&soft_limit_crossed, false, __ATOMIC_RELAXED);
+}
 
-    if (previous == NULL && next == NULL) { // only free block
-        free_list_start = NULL;
-    } else if (previous == NULL && next != NULL) { // first free block
-        ((Pointers *)get_payload_ptr(next))->previous = NULL;
-        free_list_start = next;
-    } else if (previous != NULL && next == NULL) { // last free block
-        ((Pointers *)get_payload_ptr(previous))->next = NULL;
-    } else { //sandwiched block
-        ((Pointers *)get_payload_ptr(previous))->next = next;
-        ((Pointers *)get_payload_ptr(next))->previous = previous;
+/* 
+Function: myheap_usage
+Input: None
+Return Value: size_t number
+=============================
+This function returns the number of bytes of the main heap, headers included, that are not on a free list. The reserve is not 
+counted. The shards are read without locking, so the result is approximate while other threads are allocating. 
+*/
+size_t myheap_usage(void) {
+    size_t free_bytes = 0;
+    for (size_t i = 0; i < num_shards; i++) {
+        free_bytes += __atomic_load_n(&shards[i].free_bytes, __ATOMIC_RELAXED);
     }
-
-    ((Header *)block)->allocated = 1;
+    return (myheap_reserve_start - (unsigned char *)segment_start) - free_bytes;
 }
 
-    
-/* -------------
- * HELPERS
- * -------------
- */
-
 /* 
-Function: partition
-Input: Void pointer, size_t number, and size_t number
+Function: myheap_stats
+Input: Pointer to a MyHeapStats struct
 Return Value: None
-=======================================================
-This function splits a given block into two given the available payload space and the given payload size. 
+=============================
+This function walks the free list of every shard of the main heap and records their total length, their total size, and the 
+largest free payload. Each shard is locked only while its own list is walked, so the totals are consistent per shard but not 
+across shards while other threads are allocating. The reserve is not included. 
 */
-void partition(void *block, size_t payload_space, size_t payload) {
-    void *next_block = (unsigned char *)block + payload + HEADER_SIZE;
-
-    unsigned int next_payload = payload_space - payload - HEADER_SIZE;
-    ((Header *)next_block)->payload = next_payload;
-    ((Header *)next_block)->allocated = 0;
-
-    // add to free list
-    add_block(next_block);
-    // update block with new size
-    ((Header *)block)->payload = payload;
+void myheap_stats(MyHeapStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < num_shards; i++) {
+        Shard *shard = &shards[i];
+        pthread_mutex_lock(&shard->lock);
+        for (Pointers *links = shard->free_list_start; links != NULL; links = links->next) {
+            size_t payload = get_link_payload(links);
+            stats->free_blocks++;
+            if (payload > stats->largest_free_payload) {
+                stats->largest_free_payload = payload;
+            }
+        }
+        stats->free_bytes += shard->free_bytes;
+        stats->best_fit_shards += shard->fit_policy == MYHEAP_FIT_BEST;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    stats->usage = (myheap_reserve_start - (unsigned char *)segment_start) - stats->free_bytes;
 }
 
+/* ---------------------
+ * ASYNC FREE FUNCTIONS
+ * ---------------------
+ */
+
 /* 
-Function: find_fit 
-Input: size_t number
+Function: reclaimer_main
+Input: Void pointer
 Return Value: Void pointer
-======================
-This function traverses the explicit list of free blocks to find a suitable free block given the payload size.
-It returns a pointer to the block, or NULL if a block cannot be found. If a suitable block is found, find_fit also performs 
-the necessary list and header maintenance to indicate the block is allocated. 
-*/
-void *find_fit(size_t aligned_requested_size) {
-    void *curr_block = free_list_start;
-
-    while (curr_block != NULL) {
-        unsigned int payload_space = ((Header *)curr_block)->payload;
-        if (payload_space >= aligned_requested_size) {
-            // partition the current block if large enough
-            if (payload_space >= aligned_requested_size + MIN_BLOCK_SIZE) {
-                partition(curr_block, payload_space, aligned_requested_size);
-            }
-            remove_block(curr_block);
-            return curr_block;
+=============================
+This function is the body of the background reclaimer thread. It drains the rings forever, sleeping for ASYNC_IDLE_NS after 
+any pass that found nothing to free. 
+*/
+void *reclaimer_main(void *arg) {
+    (void)arg;
+    struct timespec idle = {0, ASYNC_IDLE_NS};
+    while (true) {
+        if (drain_async_rings() == 0) {
+            nanosleep(&idle, NULL);
         }
-
-        curr_block = ((Pointers *)get_payload_ptr(curr_block))->next;
     }
-
     return NULL;
 }
 
 /* 
-Function: coalesce_right
+Function: start_reclaimer
+Input: None
+Return Value: None
+====================
+This function starts the detached background reclaimer thread. It is run once, through reclaimer_once. 
+*/
+void start_reclaimer(void) {
+    pthread_t reclaimer;
+    if (pthread_create(&reclaimer, NULL, reclaimer_main, NULL) == 0) {
+        pthread_detach(reclaimer);
+    }
+}
+
+/* 
+Function: myfree_async
 Input: Void pointer
 Return Value: None
-=========================== 
-This function consolidates as many contiguous free blocks to the right of the given block as possible. Because the 
-free list is not in address order, this function traverses the heap via pointer arthimetic, utilizing header information. This function 
-also does the necessary free list and header maintenance associated with any consolidation of blocks.
+====================
+This function queues the given payload pointer on the calling thread's ring for the background reclaimer to free. The first 
+call on a thread claims its ring. If no ring is left, or the ring is full, the pointer is freed inline by myfree. 
 */
-void coalesce_right(void *block) {
-    if (block == NULL) { // something went wrong
+void myfree_async(void *ptr) {
+    if (ptr == NULL) {
         return;
     }
-    
-    void *curr_block = (char *)block + ((Header *)block)->payload + HEADER_SIZE;
 
-    while (curr_block < segment_end && ((Header *)curr_block)->allocated == 0) {
-        ((Header *)block)->payload += ((Header *)curr_block)->payload + HEADER_SIZE;
-        remove_block(curr_block);
+    AsyncRing *ring = thread_async_ring;
+    if (ring == NULL) {
+        pthread_once(&reclaimer_once, start_reclaimer);
+        unsigned int index = __atomic_fetch_add(&num_async_rings, 1, __ATOMIC_ACQ_REL);
+        if (index >= ASYNC_MAX_RINGS) {
+            myfree(ptr);
+            return;
+        }
+        ring = thread_async_ring = &async_rings[index];
+    }
 
-        curr_block = (unsigned char *)curr_block + ((Header *)curr_block)->payload + HEADER_SIZE;
+    uint32_t tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ASYNC_RING_SIZE) { // reclaimer has fallen behind
+        myfree(ptr);
+        return;
     }
+    ring->slots[tail & (ASYNC_RING_SIZE - 1)] = ptr;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
 }
 
+/* 
+Function: myheap_drain_async
+Input: None
+Return Value: Size_t number
+=============================
+This function frees every pointer queued by myfree_async on any thread without waiting for the reclaimer. It returns the 
+number of pointers freed. 
+*/
+size_t myheap_drain_async(void) {
+    return drain_async_rings();
+}
 
 /* ---------------------
- * MAIN HEAP FUNCTIONS
+ * SNAPSHOT FUNCTIONS
  * ---------------------
  */
 
 /* 
-Function: myinit
-Input: Void pointer and size_t number
-Output: Boolean
-=======================================
-This function initializes the allocator with the given heap segment parameters as along as at least one valid request can be serviced. If the 
-allocator is successfully initialized, true is returned. Otherwise, false is returned
+Function: lock_all_shards
+Input: Boolean
+Return Value: None
+=========================
+This function locks (or, if lock is false, unlocks) every shard. Shards are always locked in index order, so two threads 
+locking all of them cannot deadlock. 
 */
-bool myinit(void *heap_start, size_t heap_size) {
-    if (heap_size <= HEADER_SIZE) {
-        return false;
+void lock_all_shards(bool lock) {
+    for (size_t i = 0; i < num_shards + num_reserve_shards; i++) {
+        if (lock) {
+            pthread_mutex_lock(&shards[i].lock);
+        } else {
+            pthread_mutex_unlock(&shards[i].lock);
+        }
     }
-    segment_start = heap_start;
-    segment_end = (unsigned char *)heap_start + heap_size;
-    segment_size = heap_size;
-   
-    free_list_start = heap_start;
-
-    // set up first header
-    unsigned int payload = heap_size - HEADER_SIZE;
-    ((Header *)segment_start)->payload = payload;
-    ((Header *)segment_start)->allocated = 0;
-
-    // set up the first pointers
-    void *payload_ptr = get_payload_ptr(segment_start);
-    ((Pointers *)payload_ptr)->previous = NULL;
-    ((Pointers *)payload_ptr)->next = NULL;
-
-    return true;  
 }
 
+/* 
+Function: myheap_snapshot_size
+Input: None
+Return Value: size_t number
+==============================
+This function returns the number of bytes a buffer passed to myheap_snapshot must hold for the current heap, which is 
+the size of the segment plus room for the allocator globals. 
+*/
+size_t myheap_snapshot_size(void) {
+    return sizeof(Snapshot) + segment_size + side_table_bytes;
+}
 
 /* 
-Function: mymalloc
-Input: Size_t number
-Return Value: Void Pointer
-========================
-This function takes in a requested payload size and finds and returns an unallocated block of memory that is sufficiently large to hold 
-the payload, or null if no such block can be found. The returned pointer points to the start of the payload space, not the header.
+Function: myheap_snapshot
+Input: Void pointer and size_t number
+Return Value: Boolean
+=======================================
+This function captures the current state of the heap into the given buffer so that it can later be returned to with 
+myheap_restore. Because free list pointers are absolute addresses, a snapshot can only be restored into the same segment 
+it was taken from. No other thread may be inside the allocator during the call, since the shard locks do not cover the 
+lock-free quick lists. Returns false if the heap is uninitialized or the buffer is too small. 
 */
-void *mymalloc(size_t requested_size) {
-    if (requested_size > MAX_REQUEST_SIZE || requested_size == 0) {
-        return NULL;
+bool myheap_snapshot(void *buf, size_t buf_size) {
+    if (segment_start == NULL || buf == NULL || buf_size < myheap_snapshot_size()) {
+        return false;
     }
 
-    size_t aligned_requested_size = align(requested_size, ALIGNMENT);
-    if (aligned_requested_size < MIN_PAYLOAD_SIZE) {
-        aligned_requested_size = MIN_PAYLOAD_SIZE;
-    }
-    
-    void *block = find_fit(aligned_requested_size);
-    if (block != NULL) {
-        return get_payload_ptr(block); // return a pointer to the start of the payload space
-    } else {
-        return NULL;
+    lock_all_shards(true);
+    Snapshot *snapshot = buf;
+    snapshot->segment_start = segment_start;
+    snapshot->segment_size = segment_size;
+    snapshot->num_shards = num_shards;
+    snapshot->reserve_start = myheap_reserve_start;
+    for (size_t i = 0; i < num_shards + num_reserve_shards; i++) {
+        snapshot->free_list_starts[i] = shards[i].free_list_start;
+        snapshot->free_bytes[i] = shards[i].free_bytes;
+        snapshot->free_slots[i] = shards[i].free_slots;
+        snapshot->fit_policies[i] = shards[i].fit_policy;
+        snapshot->window_fits[i] = shards[i].window_fits;
     }
+    snapshot->quick_flush_wanted = __atomic_load_n(&quick_flush_wanted, __ATOMIC_RELAXED);
+    snapshot->last_hot_ptr = __atomic_load_n(&last_hot_ptr, __ATOMIC_RELAXED);
+    memcpy(snapshot->tag_bytes, tag_bytes, sizeof(tag_bytes));
+    memcpy(snapshot->quick_heads, myheap_quick_heads, sizeof(myheap_quick_heads));
+    memcpy(snapshot->quick_counts, myheap_quick_counts, sizeof(myheap_quick_counts));
+    memcpy(snapshot->quick_transfer_heads, quick_transfer_heads, sizeof(quick_transfer_heads));
+    memcpy(snapshot + 1, segment_start, segment_size + side_table_bytes); // the side table follows the segment
+    lock_all_shards(false);
+
+    return true;
 }
 
 /* 
-Function: myfree 
+Function: myheap_restore
 Input: Void pointer
-Return Value: None
-====================
-This function marks the given block as available for allocation by adding it to the list of
-free blocks. Before adding to the list of free blocks, myfree also checks if the given block can be 
-coalesced with neighboring blocks to the right. Finally, it updates the block's header to reflect its deallocation. 
- */
-void myfree(void *ptr) {
-    if (ptr != NULL) {
-        void *block_ptr = (unsigned char *)ptr - HEADER_SIZE;
-        // coalesce then add to free list
-        coalesce_right(block_ptr);
-        add_block(block_ptr);
-
-        // update header to reflect deallocation   
-        ((Header *)block_ptr)->allocated = 0;      
-    }
-}
-
-/*
-Function: myrealloc 
-Input: Void pointer and a size_t number
-Return Value: Void pointer
-==========================================
-This function reallocs existing memory. Given a pointer to the payload to be reallocated and a new size, the function 
-first attempts to reallocate in place if the given block is sufficiently large or can be expanded/contracted to 
-accomodate the new size. If in-place realloc is not possible, it mallocs a new block. It returns a pointer to the "new" 
-payload space.
- */
-void *myrealloc(void *old_ptr, size_t new_size) {
-    if (old_ptr == NULL || new_size == 0) { // handling of edge cases
-        return mymalloc(new_size);
-    }
-    void *old_block_ptr = (unsigned char *)old_ptr - HEADER_SIZE;
-    size_t old_payload_size = ((Header *)old_block_ptr)->payload;
-    
-    size_t new_aligned_size = align(new_size, ALIGNMENT);
-    if (new_aligned_size < MIN_PAYLOAD_SIZE) {
-        new_aligned_size = MIN_PAYLOAD_SIZE;
+Return Value: Boolean
+=========================
+This function returns the heap to the exact state captured by myheap_snapshot, including the contents of allocated payloads. 
+The segment is compared against the snapshot one page at a time and only pages that differ are copied back, so pages the 
+program did not dirty since the snapshot are never written. Every page is still read, from both the segment and the snapshot, 
+so the cost of a restore grows with the size of the segment even when only a few pages changed. As with myheap_snapshot, no 
+other thread may be inside the allocator during the call. Returns false if the snapshot belongs to a different segment or a 
+differently sharded heap. 
+*/
+bool myheap_restore(const void *buf) {
+    const Snapshot *snapshot = buf;
+    if (snapshot == NULL || snapshot->segment_start != segment_start || snapshot->segment_size != segment_size ||
+        snapshot->num_shards != num_shards || snapshot->reserve_start != myheap_reserve_start) {
+        return false;
     }
 
-    size_t min_split = new_aligned_size + MIN_BLOCK_SIZE;
-
-    if (old_payload_size == new_aligned_size) { // don't need to do anything
-        return old_ptr;
-    }
-    if (old_payload_size > new_aligned_size && old_payload_size < min_split) { // bigger than needed, but not big enough to split 
-        return old_ptr;
-    }
-    if (old_payload_size > new_aligned_size && old_payload_size >= min_split) { // split current block
-        partition(old_block_ptr, old_payload_size, new_aligned_size);
-        
-        return old_ptr;
-    }
-    if (old_payload_size < new_aligned_size) {
-        coalesce_right(old_block_ptr);
-        unsigned int new_payload_size = ((Header *)old_block_ptr)->payload;
-        if (new_payload_size >= new_aligned_size) { // check if realloc in place is possible
-            if (new_payload_size >= min_split) {
-                partition(old_block_ptr, ((Header *)old_block_ptr)->payload, new_aligned_size);
-            }
-            return old_ptr;
-        }
-        void *realloc_block = mymalloc(new_size);
-        if (realloc_block != NULL) {
-            memcpy(realloc_block, old_ptr, old_payload_size);
-            myfree(old_ptr);
-            return realloc_block;
+    lock_all_shards(true);
+    const unsigned char *saved = (const unsigned char *)(snapshot + 1);
+    unsigned char *curr = segment_start;
+    size_t saved_size = segment_size + side_table_bytes;
+    for (size_t offset = 0; offset < saved_size; offset += PAGE_SIZE) {
+        size_t len = saved_size - offset < PAGE_SIZE ? saved_size - offset : PAGE_SIZE;
+        if (memcmp(curr + offset, saved + offset, len) != 0) {
+            memcpy(curr + offset, saved + offset, len);
         }
     }
+    for (size_t i = 0; i < num_shards + num_reserve_shards; i++) {
+        shards[i].free_list_start = snapshot->free_list_starts[i];
+        __atomic_store_n(&shards[i].free_bytes, snapshot->free_bytes[i], __ATOMIC_RELAXED);
+        shards[i].free_slots = snapshot->free_slots[i];
+        shards[i].check_block = NULL;
+        shards[i].check_link = NULL;
+        shards[i].fit_policy = snapshot->fit_policies[i];
+        shards[i].window_fits = snapshot->window_fits[i];
+    }
+    __atomic_store_n(&quick_flush_wanted, snapshot->quick_flush_wanted, __ATOMIC_RELAXED);
+    __atomic_store_n(&last_hot_ptr, snapshot->last_hot_ptr, __ATOMIC_RELAXED);
+    memcpy(tag_bytes, snapshot->tag_bytes, sizeof(tag_bytes));
+    memcpy(myheap_quick_heads, snapshot->quick_heads, sizeof(myheap_quick_heads));
+    memcpy(myheap_quick_counts, snapshot->quick_counts, sizeof(myheap_quick_counts));
+    memcpy(quick_transfer_heads, snapshot->quick_transfer_heads, sizeof(quick_transfer_heads));
+    lock_all_shards(false);
 
-    return NULL;
+    return true;
 }
 
 
-
 /* ----------------------
  * DEBUGGING FUNCTIONS
  * ----------------------
@@ -367,32 +2398,52 @@ void *myrealloc(void *old_ptr, size_t new_size) {
 
 
 /* 
-Function: validate_heap
+Function: validate_heap_full
 Input: None
 Return Value: Boolean
 ===========================
 This function performs some error checking to ensure the heap is well-formed. In particular, it checks
-that (1) blocks are properly marked as allocated and added/removed from the free list and (2) reported payload sizes
-are correct. If the heap is valid, true is returned. Otherwise, false is returned. 
+that (1) blocks are properly marked as allocated and added/removed from the free list, (2) reported payload sizes
+are correct, and (3) no two adjacent blocks in a shard are free and every boundary tag matches the block to its left. If the 
+heap is valid, true is returned. Otherwise, false is returned. 
 */
-bool validate_heap() {
-    return true; // test speed without validate_heap, comment out if you want to run validate_heap
+bool validate_heap_full(void) {
     void *curr_block = segment_start;
+    void *prev_block = NULL;
     size_t total_bytes = 0;
+    size_t free_bytes[MAX_SHARDS] = {0};
 
     while (curr_block < segment_end) {
         unsigned int payload = ((Header *)curr_block)->payload;
-        int allocated = ((Header *)curr_block)->allocated; 
+        int allocated = is_allocated(curr_block); 
         total_bytes += payload + HEADER_SIZE;
 
+        if (prev_block != NULL && curr_block != get_shard(curr_block)->start) {
+            bool prev_free = !is_allocated(prev_block);
+            if (prev_free && !allocated) {
+                printf("Adjacent free blocks not coalesced: %p %p\n", prev_block, curr_block);
+                return false;
+            }
+            if (prev_free != ((((Header *)curr_block)->status & BLOCK_PREV_FREE) != 0) ||
+                (prev_free && get_free_left_block(curr_block) != prev_block)) {
+                printf("Boundary tag incorrect: %p\n", curr_block);
+                return false;
+            }
+        }
+
         int found = 0;
         if (allocated == 0) {
-            void *curr_free = free_list_start;
+            free_bytes[get_shard(curr_block) - shards] += payload + HEADER_SIZE;
+            Pointers *curr_free = get_shard(curr_block)->free_list_start;
             while (curr_free != NULL) {
-                if (curr_free == curr_block) {
+                if (get_link_block(curr_free) == curr_block) {
                     found += 1;
+                    if (get_link_payload(curr_free) != payload) {
+                        printf("Free list payload size does not match block: %p\n", curr_block);
+                        return false;
+                    }
                 }
-                curr_free = ((Pointers *)get_payload_ptr(curr_free))->next;
+                curr_free = curr_free->next;
             }
 
             if (found == 0) {
@@ -409,6 +2460,7 @@ bool validate_heap() {
             printf("Block payload size incorrect: %p\n", curr_block);
         }
 
+        prev_block = curr_block;
         curr_block = (unsigned char *)curr_block + payload + HEADER_SIZE;
     }
 
@@ -419,9 +2471,32 @@ bool validate_heap() {
         return false;
     }
 
+    for (size_t i = 0; i < num_shards + num_reserve_shards; i++) {
+        if (free_bytes[i] != shards[i].free_bytes) {
+            printf("Free byte count of shard %zu incorrect: %zu counted, %zu recorded\n", i, free_bytes[i], shards[i].free_bytes);
+            return false;
+        }
+    }
+
     return true;
 }
 
+/* 
+Function: validate_heap
+Input: None
+Return Value: Boolean
+===========================
+The test harness calls this after every request, where the full walk would dominate the run time, so it only runs
+validate_heap_full when the allocator is built with MYHEAP_VALIDATE defined. Otherwise it returns true. 
+*/
+bool validate_heap() {
+#ifdef MYHEAP_VALIDATE
+    return validate_heap_full();
+#else
+    return true; // test speed without validate_heap, define MYHEAP_VALIDATE to run it
+#endif
+}
+
 
 /* 
 Funtion: dump_heap
@@ -436,14 +2511,13 @@ about both the blocks and the free list is printed out
 */ 
 void dump_heap(int mode) {
     void *curr_block = segment_start;
-    void *curr_free_block = free_list_start;
     void *last_viable = (char *)segment_end - MIN_BLOCK_SIZE;
 
     if (mode == 0 || mode == 2) {
         printf("Block by block\n");
         while (curr_block <= last_viable) {
             unsigned int payload = ((Header *)curr_block)->payload;
-            int allocated = ((Header *)curr_block)->allocated;
+            int allocated = is_allocated(curr_block);
 
             void *next_block = (unsigned char *)curr_block + payload + HEADER_SIZE;
 
@@ -462,18 +2536,21 @@ void dump_heap(int mode) {
 
     if (mode == 1 || mode == 2) {
 
-        printf("Free block list\n");
-        while (curr_free_block != NULL) {
-            void *previous = ((Pointers *)get_payload_ptr(curr_free_block))->previous;
-            void *next = ((Pointers *)get_payload_ptr(curr_free_block))->next;
+        for (size_t i = 0; i < num_shards + num_reserve_shards; i++) {
+            Pointers *curr_links = shards[i].free_list_start;
+            printf("Free block list of shard %zu\n", i);
+            while (curr_links != NULL) {
+                Pointers *previous = curr_links->previous;
+                Pointers *next = curr_links->next;
 
-            printf("========================\n");
-            printf("Free Block: %p\n", curr_free_block);
-            printf("Payload: %u\n", ((Header *)curr_free_block)->payload);
-            printf("Previous free: %p\n", previous);
-            printf("Next free: %p\n", next);
+                printf("========================\n");
+                printf("Free Block: %p\n", get_link_block(curr_links));
+                printf("Payload: %u\n", get_link_payload(curr_links));
+                printf("Previous free: %p\n", previous != NULL ? get_link_block(previous) : NULL);
+                printf("Next free: %p\n", next != NULL ? get_link_block(next) : NULL);
 
-            curr_free_block = next;
+                curr_links = next;
+            }
         }
     }   
 }
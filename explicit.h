@@ -0,0 +1,270 @@
+/*
+Mondee Lu, cs107, explicit.h
+This header declares the extensions to the allocator.h interface that are specific to the explicit list heap allocator
+implemented in explicit.c. The core mymalloc, myrealloc, and myfree functions are still declared by allocator.h.
+*/
+#ifndef EXPLICIT_H
+#define EXPLICIT_H
+
+#include "allocator.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ------------------
+ * CONFIGURATION
+ * ------------------
+ */
+
+// a myheap_config.h on the include path (such as one written by tuner.c) overrides the defaults below and in explicit.c
+#if defined(__has_include)
+#if __has_include("myheap_config.h")
+#include "myheap_config.h"
+#endif
+#endif
+
+#define MYHEAP_FIT_FIRST 0 // first block on the free list that is large enough
+#define MYHEAP_FIT_BEST 1 // smallest block on the free list that is large enough
+#ifndef MYHEAP_FIT_POLICY
+#define MYHEAP_FIT_POLICY MYHEAP_FIT_FIRST
+#endif
+
+/* ------------------
+ * INITIALIZATION
+ * ------------------
+ */
+
+// optional features for myinit_opts, zero-initialize for the myinit defaults
+typedef struct MyHeapOptions {
+    size_t num_shards; // independently locked address ranges the segment is split into, 0 or 1 for one
+    size_t max_request_size; // init fails if a request this large could not fit in every shard, 0 for no check
+    size_t soft_limit; // usage above which the reclaimers are asked to shrink, 0 for none
+    size_t hard_limit; // usage that allocations may not push the heap past, 0 for none
+    size_t reserve_size; // bytes at the end of the segment kept for MYMALLOC_CRITICAL requests, 0 for none
+    bool prefault; // touch every page of the segment during init
+    bool lock_pages; // mlock the segment during init, init fails if it cannot
+    size_t side_link_slots; // free list links kept in a table at the end of the segment instead of in free payloads, 32 bytes per slot, 0 for none
+    size_t check_per_op; // blocks and free list links checked by each malloc and free, 0 for none
+    bool adaptive; // switch each shard between first and best fit as its fragmentation changes
+} MyHeapOptions;
+
+// myinit with the features requested in opts, which may be NULL
+bool myinit_opts(void *heap_start, size_t heap_size, const MyHeapOptions *opts);
+// faults in about bytes more of the segment, in address order, returns how many bytes it touched
+size_t myheap_warm(size_t bytes);
+
+/* ------------------
+ * MEMORY PRESSURE
+ * ------------------
+ */
+
+#define MYHEAP_MAX_RECLAIMERS 8
+
+// asked to free about bytes_wanted bytes (with myfree, never by allocating), returns roughly how many it freed
+typedef size_t (*myheap_reclaimer)(size_t bytes_wanted, void *arg);
+
+// registers a callback run when usage crosses the soft limit or an allocation would fail, returns false if the table is full
+bool myheap_register_reclaimer(myheap_reclaimer reclaimer, void *arg);
+// changes the limits set through MyHeapOptions, 0 for none
+void myheap_set_limits(size_t soft_limit, size_t hard_limit);
+// bytes of the segment, headers included, that are not on a free list
+size_t myheap_usage(void);
+
+// shape of the main heap's free lists, filled in by myheap_stats
+typedef struct MyHeapStats {
+    size_t usage; // as returned by myheap_usage
+    size_t free_bytes; // bytes on the free lists, headers included
+    size_t free_blocks; // total length of the free lists
+    size_t largest_free_payload; // payload of the largest free block, 0 if there is none
+    size_t best_fit_shards; // shards currently placing with best fit
+} MyHeapStats;
+
+// walks every free list of the main heap, locking one shard at a time
+void myheap_stats(MyHeapStats *stats);
+// walks the whole segment and checks every block, free list, and boundary tag, printing the first problem it finds; unlike
+// validate_heap it always runs, and it must not race with other calls into the allocator
+bool validate_heap_full(void);
+
+/* ------------------
+ * ALLOCATION HINTS
+ * ------------------
+ */
+
+#define MYMALLOC_SHORT_LIVED 0x1 // freed soon after it is allocated, placed in the lowest free block that fits
+#define MYMALLOC_LONG_LIVED 0x2 // expected to outlive most other objects, carved from the high end of the segment
+#define MYMALLOC_HOT 0x4 // accessed frequently, placed near the previous hot object
+#define MYMALLOC_COLD 0x8 // rarely accessed after it is written, placed like MYMALLOC_LONG_LIVED
+#define MYMALLOC_CRITICAL 0x10 // served from the reserve first, for paths that must not fail under exhaustion
+
+// mymalloc that places the block according to the MYMALLOC_* hints in flags
+void *mymalloc_flags(size_t requested_size, unsigned int flags);
+// mymalloc that prefers a block on the same page (or huge page) as near_ptr
+void *mymalloc_near(void *near_ptr, size_t requested_size);
+#define MYHEAP_MAX_TAGS 256 // tags run from 1 to MYHEAP_MAX_TAGS - 1, tag 0 is untagged
+#define MYHEAP_TAG_SHIFT 4 // allocated blocks keep their tag in the header's status word from this bit up
+
+// mymalloc that charges the payload to the given tag until it is freed with myfree
+void *mymalloc_tagged(size_t requested_size, unsigned int tag);
+// payload bytes currently allocated under the given tag
+size_t myheap_tag_bytes(unsigned int tag);
+// mymalloc whose payload starts on a cache line and fills whole lines, so it never shares a line with another object
+void *mymalloc_cacheline(size_t requested_size);
+
+/* ------------------
+ * FAST PATH
+ * ------------------
+ */
+
+#define MYHEAP_HEADER_SIZE 8 // size of a block header, which starts with the 4-byte payload size
+#ifndef QUICK_MAX_PAYLOAD
+#define QUICK_MAX_PAYLOAD 128 // largest payload served by the quick lists, a multiple of 8 of at least 16
+#endif
+#if QUICK_MAX_PAYLOAD < 16 || QUICK_MAX_PAYLOAD % 8 != 0
+#error "QUICK_MAX_PAYLOAD must be a multiple of 8 of at least 16"
+#endif
+#define QUICK_NUM_CLASSES (QUICK_MAX_PAYLOAD / 8 - 1) // one class per 8-byte payload size from 16 to QUICK_MAX_PAYLOAD
+// size class of a request in 1..QUICK_MAX_PAYLOAD, a constant expression when size is one
+#define QUICK_CLASS(size) ((size) <= 16 ? 0 : (((size) + 7) >> 3) - 2)
+
+// the quick lists are replicated per CPU (with MYHEAP_PER_CPU defined) or per thread, so that threads rarely contend on a head
+#define QUICK_NUM_SLOTS 64
+// a list holding this many blocks donates them all to the shared transfer cache, where starving slots steal them a batch at a time
+#define QUICK_MAX_CACHED 64
+
+// a quick list head packs the segment offset of the top block with a version tag that defeats ABA on compare-and-swap
+#define QUICK_EMPTY 0xFFFFFFFFu // offset of the top block when the list is empty
+#define QUICK_HEAD(offset, tag) (((uint64_t)(tag) << 32) | (uint32_t)(offset))
+#define QUICK_OFFSET(head) ((uint32_t)(head))
+#define QUICK_TAG(head) ((uint32_t)((head) >> 32))
+
+// heads of the quick lists, each a lock-free stack of allocated blocks whose payload exactly matches the class
+extern uint64_t myheap_quick_heads[QUICK_NUM_SLOTS][QUICK_NUM_CLASSES];
+// approximate number of blocks on each quick list
+extern int32_t myheap_quick_counts[QUICK_NUM_SLOTS][QUICK_NUM_CLASSES];
+// start of the segment that quick list offsets are relative to
+extern unsigned char *myheap_quick_base;
+// slot of the calling thread plus one, or 0 before the thread's first quick list operation
+extern __thread unsigned int myheap_quick_thread_slot;
+// start of the reserve (the end of the segment if there is none), blocks at or past it are never cached
+extern unsigned char *myheap_reserve_start;
+
+// out-of-line slow path, called when a quick list is empty
+void *mymalloc_quick_refill(size_t requested_size);
+// returns every cached block to the heap, true if any were cached
+bool myheap_quick_flush(void);
+// gives the calling thread its own slot, round robin
+unsigned int myheap_quick_assign_slot(void);
+// moves an overfull quick list to the shared transfer cache
+void myheap_quick_donate(unsigned int slot, size_t size_class);
+
+#ifdef MYHEAP_PER_CPU
+int sched_getcpu(void); // from <sched.h>, which only declares it under _GNU_SOURCE
+#endif
+
+// slot of the quick lists the calling thread should use
+static inline unsigned int myheap_quick_slot(void) {
+#ifdef MYHEAP_PER_CPU
+    // glibc answers this from the thread's rseq area without a system call
+    int cpu = sched_getcpu();
+    if (cpu >= 0) {
+        return (unsigned int)cpu % QUICK_NUM_SLOTS;
+    }
+#endif
+    unsigned int slot = myheap_quick_thread_slot;
+    return slot != 0 ? slot - 1 : myheap_quick_assign_slot();
+}
+
+// pushes an allocated block onto the quick list with the given head
+static inline void myheap_quick_push(uint64_t *list, void *block) {
+    uint32_t *next = (uint32_t *)((unsigned char *)block + MYHEAP_HEADER_SIZE);
+    uint32_t offset = (unsigned char *)block - myheap_quick_base;
+    uint64_t head = __atomic_load_n(list, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(next, QUICK_OFFSET(head), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(list, &head, QUICK_HEAD(offset, QUICK_TAG(head) + 1),
+                                          true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// pops a block from the quick list with the given head, or returns NULL if it is empty
+static inline void *myheap_quick_pop(uint64_t *list) {
+    uint64_t head = __atomic_load_n(list, __ATOMIC_ACQUIRE);
+    while (QUICK_OFFSET(head) != QUICK_EMPTY) {
+        unsigned char *block = myheap_quick_base + QUICK_OFFSET(head);
+        // may read a block another thread just popped, in which case the tag has moved on and the swap fails
+        uint32_t next = __atomic_load_n((uint32_t *)(block + MYHEAP_HEADER_SIZE), __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(list, &head, QUICK_HEAD(next, QUICK_TAG(head) + 1),
+                                        true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+// pops a block of the given size class, requested_size must belong to that class
+static inline void *mymalloc_class(size_t size_class, size_t requested_size) {
+    unsigned int slot = myheap_quick_slot();
+    unsigned char *block = myheap_quick_pop(&myheap_quick_heads[slot][size_class]);
+    if (block != NULL) {
+        __atomic_fetch_sub(&myheap_quick_counts[slot][size_class], 1, __ATOMIC_RELAXED);
+        return block + MYHEAP_HEADER_SIZE;
+    }
+    return mymalloc_quick_refill(requested_size);
+}
+
+// mymalloc that serves small requests from the quick lists without leaving the call site
+static inline void *mymalloc_small(size_t requested_size) {
+    if (requested_size - 1 < QUICK_MAX_PAYLOAD) { // also rejects 0
+        return mymalloc_class(QUICK_CLASS(requested_size), requested_size);
+    }
+    return mymalloc(requested_size);
+}
+
+// mymalloc_small for a size known at compile time, which fails to compile unless size fits a quick list
+#define mymalloc_fixed(size) \
+    ((void)sizeof(struct { int quick_size_check : ((size) > 0 && (size) <= QUICK_MAX_PAYLOAD) ? 1 : -1; }), \
+     mymalloc_class(QUICK_CLASS(size), (size)))
+
+// myfree that caches small blocks on the quick lists instead of returning them to the heap
+static inline void myfree_small(void *ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    unsigned char *block = (unsigned char *)ptr - MYHEAP_HEADER_SIZE;
+    unsigned int payload = *(unsigned int *)block;
+    unsigned int tag = __atomic_load_n((unsigned int *)(block + 4), __ATOMIC_RELAXED) >> MYHEAP_TAG_SHIFT;
+    if (payload <= QUICK_MAX_PAYLOAD && block < myheap_reserve_start && tag == 0) {
+        unsigned int slot = myheap_quick_slot();
+        size_t size_class = payload / 8 - 2;
+        myheap_quick_push(&myheap_quick_heads[slot][size_class], block);
+        if (__atomic_add_fetch(&myheap_quick_counts[slot][size_class], 1, __ATOMIC_RELAXED) >= QUICK_MAX_CACHED) {
+            myheap_quick_donate(slot, size_class);
+        }
+    } else {
+        myfree(ptr);
+    }
+}
+
+/* ------------------
+ * SNAPSHOTS
+ * ------------------
+ */
+
+// number of bytes a caller must provide to myheap_snapshot
+size_t myheap_snapshot_size(void);
+// copies the heap segment and allocator state into buf; no other thread may be inside the allocator during the call
+bool myheap_snapshot(void *buf, size_t buf_size);
+// returns the heap to the exact state captured in buf, reading the whole segment to find the pages that changed; no other thread
+// may be inside the allocator during the call
+bool myheap_restore(const void *buf);
+
+/* ------------------
+ * ASYNC FREE
+ * ------------------
+ */
+
+// queues ptr to be freed by the background reclaimer, freeing it inline only if the thread's queue is full
+void myfree_async(void *ptr);
+// frees every pointer queued by myfree_async on any thread and returns how many were freed
+size_t myheap_drain_async(void);
+
+#endif
@@ -0,0 +1,372 @@
+/*
+Mondee Lu, cs107, heap.hpp
+This header implements the explicit list heap allocator from explicit.c as a C++ class template whose design decisions are supplied
+as policy classes:
+
+    Heap<HeaderPolicy, FitPolicy, InsertPolicy, CoalescePolicy, LockPolicy>
+
+HeaderPolicy decides the block header layout and the minimum payload size, FitPolicy decides which free block services a request,
+InsertPolicy decides where freed blocks go in the free list, CoalescePolicy decides which neighbors are merged when a block is freed,
+and LockPolicy decides how concurrent callers are serialized. The default arguments reproduce the original explicit.c: an 8-byte
+header, a 16-byte minimum payload, a first-fit search, LIFO insertion, right-only coalescing, and no locking. (explicit.c has since
+moved to boundary tags and coalesces in both directions.)
+
+Policies are plain classes with static member functions (LockPolicy is the only one with state), so every call is resolved at compile
+time and inlined. Nothing is dispatched through a virtual function. A service can pick a different combination by naming it:
+
+    myheap::Heap<myheap::DefaultHeader, myheap::BestFit, myheap::AddressOrderedInsert> heap;
+    heap.init(segment, segment_size);
+    void *ptr = heap.malloc(64);
+*/
+#ifndef HEAP_HPP
+#define HEAP_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+
+namespace myheap {
+
+constexpr size_t ALIGNMENT = 8;
+constexpr size_t MAX_REQUEST_SIZE = 1 << 30;
+
+// 16-byte struct to hold pointers, stored in the payload of free blocks
+struct Pointers {
+    void *previous;
+    void *next;
+};
+
+/* ------------------
+ * HEADER POLICIES
+ * ------------------
+ */
+
+// 8-byte header holding the payload size and the allocated flag, as in explicit.c
+struct DefaultHeader {
+    struct Header {
+        unsigned int payload;
+        int allocated;
+    };
+
+    static constexpr size_t HEADER_SIZE = sizeof(Header);
+    static constexpr size_t MIN_PAYLOAD_SIZE = sizeof(Pointers);
+
+    static size_t payload(const void *block) { return static_cast<const Header *>(block)->payload; }
+    static void set_payload(void *block, size_t payload) { static_cast<Header *>(block)->payload = payload; }
+    static bool allocated(const void *block) { return static_cast<const Header *>(block)->allocated != 0; }
+    static void set_allocated(void *block, bool allocated) { static_cast<Header *>(block)->allocated = allocated; }
+};
+
+/* ------------------
+ * FIT POLICIES
+ * ------------------
+ */
+
+// returns the first free block in list order that is large enough, as in explicit.c's find_fit
+struct FirstFit {
+    template <class HeapType>
+    static void *find(const HeapType &heap, size_t aligned_requested_size) {
+        for (void *block = heap.free_list_start(); block != nullptr; block = heap.next_free(block)) {
+            if (heap.payload(block) >= aligned_requested_size) {
+                return block;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// returns the smallest free block that is large enough, stopping early on an exact fit
+struct BestFit {
+    template <class HeapType>
+    static void *find(const HeapType &heap, size_t aligned_requested_size) {
+        void *best_block = nullptr;
+        for (void *block = heap.free_list_start(); block != nullptr; block = heap.next_free(block)) {
+            size_t payload = heap.payload(block);
+            if (payload == aligned_requested_size) {
+                return block;
+            }
+            if (payload > aligned_requested_size && (best_block == nullptr || payload < heap.payload(best_block))) {
+                best_block = block;
+            }
+        }
+        return best_block;
+    }
+};
+
+/* ------------------
+ * INSERT POLICIES
+ * ------------------
+ */
+
+// freed blocks go to the front of the list, as in explicit.c's add_block
+struct LifoInsert {
+    template <class HeapType>
+    static void *find_previous(const HeapType &, void *) {
+        return nullptr;
+    }
+};
+
+// the free list is kept sorted by address, which makes first fit behave like address-ordered first fit
+struct AddressOrderedInsert {
+    template <class HeapType>
+    static void *find_previous(const HeapType &heap, void *block) {
+        void *previous = nullptr;
+        for (void *curr = heap.free_list_start(); curr != nullptr && curr < block; curr = heap.next_free(curr)) {
+            previous = curr;
+        }
+        return previous;
+    }
+};
+
+/* ------------------
+ * COALESCE POLICIES
+ * ------------------
+ */
+
+// merges every contiguous free block to the right of the given block, as in explicit.c's coalesce_right
+struct CoalesceRight {
+    template <class HeapType>
+    static void coalesce(HeapType &heap, void *block) {
+        void *curr_block = heap.next_block(block);
+        while (curr_block < heap.segment_end() && !heap.allocated(curr_block)) {
+            heap.remove_block(curr_block);
+            heap.set_payload(block, heap.payload(block) + heap.payload(curr_block) + heap.HEADER_SIZE);
+            curr_block = heap.next_block(block);
+        }
+    }
+};
+
+// never merges blocks, trading fragmentation for the cheapest possible free
+struct NoCoalesce {
+    template <class HeapType>
+    static void coalesce(HeapType &, void *) {}
+};
+
+/* ------------------
+ * LOCK POLICIES
+ * ------------------
+ */
+
+// single-threaded use, as in explicit.c
+struct NoLock {
+    void lock() {}
+    void unlock() {}
+};
+
+// serializes every heap operation on one mutex
+struct MutexLock {
+    std::mutex mutex;
+    void lock() { mutex.lock(); }
+    void unlock() { mutex.unlock(); }
+};
+
+/* ------------------
+ * HEAP
+ * ------------------
+ */
+
+template <class HeaderPolicy = DefaultHeader, class FitPolicy = FirstFit, class InsertPolicy = LifoInsert,
+          class CoalescePolicy = CoalesceRight, class LockPolicy = NoLock>
+class Heap {
+public:
+    static constexpr size_t HEADER_SIZE = HeaderPolicy::HEADER_SIZE;
+    static constexpr size_t MIN_PAYLOAD_SIZE = HeaderPolicy::MIN_PAYLOAD_SIZE;
+    static constexpr size_t MIN_BLOCK_SIZE = HEADER_SIZE + MIN_PAYLOAD_SIZE;
+
+    static_assert(MIN_PAYLOAD_SIZE >= sizeof(Pointers), "free blocks must be able to hold their list pointers");
+    static_assert(HEADER_SIZE % ALIGNMENT == 0, "headers must keep payloads aligned");
+
+    /*
+    Function: init
+    Input: Void pointer and size_t number
+    Return Value: Boolean
+    =======================================
+    Takes over the given heap segment and turns it into one free block. Returns false if the segment cannot hold a block.
+    */
+    bool init(void *heap_start, size_t heap_size) {
+        if (heap_size < MIN_BLOCK_SIZE) {
+            return false;
+        }
+        segment_end_ = static_cast<unsigned char *>(heap_start) + heap_size;
+        free_list_start_ = nullptr;
+
+        set_payload(heap_start, heap_size - HEADER_SIZE);
+        add_block(heap_start);
+        return true;
+    }
+
+    /*
+    Function: malloc
+    Input: size_t number
+    Return Value: Void pointer
+    ============================
+    Returns a payload of at least the requested size chosen by FitPolicy, or nullptr if none is available.
+    */
+    void *malloc(size_t requested_size) {
+        if (requested_size > MAX_REQUEST_SIZE || requested_size == 0) {
+            return nullptr;
+        }
+        Guard guard(lock_);
+        return malloc_unlocked(get_aligned_size(requested_size));
+    }
+
+    /*
+    Function: free
+    Input: Void pointer
+    Return Value: None
+    ====================
+    Coalesces the block according to CoalescePolicy and returns it to the free list according to InsertPolicy.
+    */
+    void free(void *ptr) {
+        if (ptr == nullptr) {
+            return;
+        }
+        Guard guard(lock_);
+        free_unlocked(ptr);
+    }
+
+    /*
+    Function: realloc
+    Input: Void pointer and size_t number
+    Return Value: Void pointer
+    =======================================
+    Resizes in place when the block, possibly grown by coalescing, is large enough. Otherwise moves the payload to a new block.
+    Returns nullptr, leaving the old payload allocated, if the new size is above MAX_REQUEST_SIZE or no block is available.
+    */
+    void *realloc(void *old_ptr, size_t new_size) {
+        if (old_ptr == nullptr || new_size == 0) {
+            return malloc(new_size);
+        }
+        if (new_size > MAX_REQUEST_SIZE) {
+            return nullptr;
+        }
+        Guard guard(lock_);
+        void *old_block = static_cast<unsigned char *>(old_ptr) - HEADER_SIZE;
+        size_t old_payload_size = payload(old_block);
+        size_t new_aligned_size = get_aligned_size(new_size);
+
+        if (old_payload_size >= new_aligned_size) {
+            split(old_block, new_aligned_size);
+            return old_ptr;
+        }
+
+        CoalescePolicy::coalesce(*this, old_block);
+        if (payload(old_block) >= new_aligned_size) {
+            split(old_block, new_aligned_size);
+            return old_ptr;
+        }
+
+        void *new_ptr = malloc_unlocked(new_aligned_size);
+        if (new_ptr != nullptr) {
+            std::memcpy(new_ptr, old_ptr, old_payload_size);
+            free_unlocked(old_ptr);
+        }
+        return new_ptr;
+    }
+
+    // block and free list accessors used by the policies
+    size_t payload(const void *block) const { return HeaderPolicy::payload(block); }
+    void set_payload(void *block, size_t payload) { HeaderPolicy::set_payload(block, payload); }
+    bool allocated(const void *block) const { return HeaderPolicy::allocated(block); }
+    void *segment_end() const { return segment_end_; }
+    void *free_list_start() const { return free_list_start_; }
+    void *next_free(void *block) const { return links(block)->next; }
+    void *next_block(void *block) const { return static_cast<unsigned char *>(block) + HEADER_SIZE + payload(block); }
+
+    /*
+    Function: add_block
+    Input: Void pointer
+    Return Value: None
+    =========================
+    Links the block into the free list after the block chosen by InsertPolicy and marks it free.
+    */
+    void add_block(void *block) {
+        void *previous = InsertPolicy::find_previous(*this, block);
+        void *next = previous != nullptr ? links(previous)->next : free_list_start_;
+
+        links(block)->previous = previous;
+        links(block)->next = next;
+        if (next != nullptr) {
+            links(next)->previous = block;
+        }
+        if (previous != nullptr) {
+            links(previous)->next = block;
+        } else {
+            free_list_start_ = block;
+        }
+        HeaderPolicy::set_allocated(block, false);
+    }
+
+    /*
+    Function: remove_block
+    Input: Void pointer
+    Return Value: None
+    =======================
+    Unlinks the block from the free list and marks it allocated.
+    */
+    void remove_block(void *block) {
+        void *previous = links(block)->previous;
+        void *next = links(block)->next;
+
+        if (previous != nullptr) {
+            links(previous)->next = next;
+        } else {
+            free_list_start_ = next;
+        }
+        if (next != nullptr) {
+            links(next)->previous = previous;
+        }
+        HeaderPolicy::set_allocated(block, true);
+    }
+
+private:
+    struct Guard {
+        LockPolicy &lock;
+        explicit Guard(LockPolicy &lock) : lock(lock) { lock.lock(); }
+        ~Guard() { lock.unlock(); }
+    };
+
+    static size_t get_aligned_size(size_t requested_size) {
+        size_t aligned_size = (requested_size + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1);
+        return aligned_size < MIN_PAYLOAD_SIZE ? MIN_PAYLOAD_SIZE : aligned_size;
+    }
+
+    Pointers *links(void *block) const {
+        return reinterpret_cast<Pointers *>(static_cast<unsigned char *>(block) + HEADER_SIZE);
+    }
+
+    // gives any space beyond the payload size back to the free list when it can hold a block of its own
+    void split(void *block, size_t aligned_size) {
+        size_t payload_space = payload(block);
+        if (payload_space >= aligned_size + MIN_BLOCK_SIZE) {
+            void *remainder = static_cast<unsigned char *>(block) + HEADER_SIZE + aligned_size;
+            set_payload(remainder, payload_space - aligned_size - HEADER_SIZE);
+            set_payload(block, aligned_size);
+            add_block(remainder);
+        }
+    }
+
+    void *malloc_unlocked(size_t aligned_size) {
+        void *block = FitPolicy::find(*this, aligned_size);
+        if (block == nullptr) {
+            return nullptr;
+        }
+        split(block, aligned_size);
+        remove_block(block);
+        return static_cast<unsigned char *>(block) + HEADER_SIZE;
+    }
+
+    void free_unlocked(void *ptr) {
+        void *block = static_cast<unsigned char *>(ptr) - HEADER_SIZE;
+        CoalescePolicy::coalesce(*this, block);
+        add_block(block);
+    }
+
+    void *segment_end_ = nullptr;
+    void *free_list_start_ = nullptr;
+    LockPolicy lock_;
+};
+
+} // namespace myheap
+
+#endif
@@ -0,0 +1,153 @@
+/*
+Mondee Lu, cs107, policies.cpp
+This program tests the policy-based heap template in heap.hpp. It instantiates Heap with the default policies and with several
+alternative combinations, runs the same seeded sequence of malloc, realloc, and free calls against each, and checks the heap
+after every call.
+
+WORKLOAD: A table of slots holds the live payloads. Each operation picks a slot: an empty slot is filled by a malloc of a random
+size, and an occupied one is either reallocated to a new random size or freed. Every payload is filled with a byte derived from its
+slot, and that byte is checked before the payload is reallocated or freed, and again after a realloc up to the old size. The
+sequence also asks for sizes just above MAX_REQUEST_SIZE and near SIZE_MAX, which must fail without touching the heap.
+
+CHECKS: After every operation the blocks are walked in address order from the start of the segment, and they must end exactly at
+the segment end. Every free block must be on the free list exactly once and every block on the list must be free, and under
+AddressOrderedInsert the list must be sorted by address. At the end every slot is freed. The exit status is 0 only if every
+configuration passed.
+
+USAGE: ./policies [ops] [seed]
+*/
+#include "heap.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#define DEFAULT_OPS 20000
+#define HEAP_SIZE (1 << 20)
+#define NUM_SLOTS 256
+#define MAX_SIZE 2000
+
+/*
+Function: heap_intact
+Input: Reference to a heap, the start of its segment, and whether the free list is address ordered
+Return Value: Boolean
+=====================================================
+Walks the blocks and the free list of the heap as described in the CHECKS section, printing the first problem it finds.
+*/
+template <class HeapType>
+bool heap_intact(const HeapType &heap, void *heap_start, bool address_ordered) {
+    unsigned char *segment_start = static_cast<unsigned char *>(heap_start);
+    size_t segment_size = static_cast<unsigned char *>(heap.segment_end()) - segment_start;
+    std::vector<bool> listed(segment_size / myheap::ALIGNMENT); // free list blocks, indexed by offset / ALIGNMENT
+    void *previous = nullptr;
+    for (void *curr = heap.free_list_start(); curr != nullptr; curr = heap.next_free(curr)) {
+        size_t offset = static_cast<unsigned char *>(curr) - segment_start;
+        if (curr < heap_start || curr >= heap.segment_end() || listed[offset / myheap::ALIGNMENT] || heap.allocated(curr)) {
+            printf("free list holds a stray, repeated, or allocated block at %p\n", curr);
+            return false;
+        }
+        if (address_ordered && previous != nullptr && previous >= curr) {
+            printf("free list is out of address order at %p\n", curr);
+            return false;
+        }
+        listed[offset / myheap::ALIGNMENT] = true;
+        previous = curr;
+    }
+
+    unsigned char *block = segment_start;
+    while (block < heap.segment_end()) {
+        if (!heap.allocated(block) && !listed[(block - segment_start) / myheap::ALIGNMENT]) {
+            printf("free block %p is not on the free list\n", static_cast<void *>(block));
+            return false;
+        }
+        block = static_cast<unsigned char *>(heap.next_block(block));
+    }
+    if (block != heap.segment_end()) {
+        printf("blocks run past the segment end\n");
+        return false;
+    }
+    return true;
+}
+
+/*
+Function: payload_intact
+Input: Pointer to a payload, size_t number, and fill byte
+Return Value: Boolean
+=====================================================
+Returns true if the first size bytes of the payload all hold the fill byte.
+*/
+bool payload_intact(const unsigned char *payload, size_t size, unsigned char fill) {
+    for (size_t i = 0; i < size; i++) {
+        if (payload[i] != fill) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Function: run_config
+Input: Name of the configuration, number of operations, seed, and whether the free list is address ordered
+Return Value: Boolean
+=====================================================
+Runs the workload against a fresh heap of the given Heap<...> type and prints one line with the result.
+*/
+template <class HeapType>
+bool run_config(const char *name, size_t ops, unsigned int seed, bool address_ordered) {
+    HeapType heap;
+    std::vector<unsigned char> segment(HEAP_SIZE);
+    std::vector<unsigned char *> payloads(NUM_SLOTS, nullptr);
+    std::vector<size_t> sizes(NUM_SLOTS, 0);
+    bool ok = heap.init(segment.data(), segment.size()) && heap.malloc(myheap::MAX_REQUEST_SIZE + 1) == nullptr;
+
+    for (size_t op = 0; op < ops && ok; op++) {
+        size_t slot = rand_r(&seed) % NUM_SLOTS;
+        unsigned char fill = static_cast<unsigned char>(slot);
+        size_t size = 1 + rand_r(&seed) % MAX_SIZE;
+        if (payloads[slot] == nullptr) {
+            payloads[slot] = static_cast<unsigned char *>(heap.malloc(size));
+            sizes[slot] = payloads[slot] != nullptr ? size : 0;
+        } else if (!payload_intact(payloads[slot], sizes[slot], fill)) {
+            printf("%s: payload in slot %zu was overwritten\n", name, slot);
+            ok = false;
+        } else if (rand_r(&seed) % 3 == 0) {
+            ok = heap.realloc(payloads[slot], SIZE_MAX - rand_r(&seed) % 16) == nullptr &&
+                 heap.realloc(payloads[slot], myheap::MAX_REQUEST_SIZE + 1) == nullptr;
+            unsigned char *resized = static_cast<unsigned char *>(heap.realloc(payloads[slot], size));
+            if (resized != nullptr) {
+                ok = ok && payload_intact(resized, size < sizes[slot] ? size : sizes[slot], fill);
+                payloads[slot] = resized;
+                sizes[slot] = size;
+            }
+        } else {
+            heap.free(payloads[slot]);
+            payloads[slot] = nullptr;
+            sizes[slot] = 0;
+        }
+        if (payloads[slot] != nullptr) {
+            std::memset(payloads[slot], fill, sizes[slot]);
+        }
+        ok = ok && heap_intact(heap, segment.data(), address_ordered);
+    }
+
+    for (size_t slot = 0; slot < NUM_SLOTS; slot++) {
+        heap.free(payloads[slot]);
+    }
+    ok = ok && heap_intact(heap, segment.data(), address_ordered);
+    printf("%-28s %s\n", name, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    using namespace myheap;
+    size_t ops = argc > 1 ? strtoul(argv[1], nullptr, 10) : DEFAULT_OPS;
+    unsigned int seed = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1;
+
+    bool ok = run_config<Heap<>>("default", ops, seed, false);
+    ok = run_config<Heap<DefaultHeader, BestFit>>("best-fit", ops, seed, false) && ok;
+    ok = run_config<Heap<DefaultHeader, FirstFit, AddressOrderedInsert>>("address-ordered", ops, seed, true) && ok;
+    ok = run_config<Heap<DefaultHeader, BestFit, AddressOrderedInsert, NoCoalesce, MutexLock>>("best-fit-no-coalesce-mutex", ops,
+                                                                                               seed, true) && ok;
+    return ok ? 0 : 1;
+}
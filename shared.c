@@ -0,0 +1,503 @@
+/*
+Mondee Lu, cs107, shared.c
+This program implements an explicit list heap allocator that can be shared by several processes.
+
+SEGMENT LAYOUT: Every piece of allocator state is kept in the segment, so processes that map the same shared memory object see the
+same heap. The segment starts with a SharedControl block holding a magic number, the lock, the segment size, and the head of the
+free list, followed by the blocks. The only per-process state is the address this process mapped the segment at.
+
+MEMORY BLOCK DESIGN: Blocks have the same 8-byte header as explicit.c: a 4-byte payload size and a 4-byte status word with an
+allocated bit and a bit saying the block to the left is free. Since the segment may be mapped at a different address in each
+process, free list links are 32-bit offsets from the start of the segment rather than pointers, and callers exchange payloads as
+offsets too (myshared_offset and myshared_ptr). A free block holds its two links at the start of its payload and a copy of its
+payload size in its last 4 bytes, which is why payloads are at least 16 bytes. Freeing coalesces in both directions, so no two
+adjacent blocks are ever both free. The free list is LIFO and searched first fit. Every helper is static, so shared.h is the whole
+interface and a program can link this heap together with explicit.c.
+
+LOCKING: One process-shared, robust pthread mutex in the control block guards the heap. If a process dies holding it, the next
+process to lock it gets EOWNERDEAD and repairs the heap before marking the mutex consistent.
+
+CRASH RECOVERY: Every operation changes the block headers in an order where a single 4-byte store commits it: a split writes the
+header of the remainder before shrinking the block, a merge grows the surviving block with one store, and allocating or freeing
+flips the status word last. Whatever point a process dies at, walking the segment by header sizes therefore still visits a valid
+sequence of blocks. The repair walks it, merges adjacent free blocks, rebuilds the free list and the boundary tags from the headers,
+and recounts the free bytes. Only the free list links, which the repair throws away, can be left half updated. Blocks the dead
+process had allocated are not freed, since another process may have been handed their offsets. If the walk finds a header that
+cannot be valid, the heap is marked corrupt and every later call fails.
+*/
+#include "shared.h"
+#include "debug_break.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define ALIGNMENT 8
+#define MAX_REQUEST_SIZE (1 << 30)
+#define HEADER_SIZE 8
+#define MIN_PAYLOAD_SIZE 16 // two links and the footer
+#define MIN_BLOCK_SIZE 24
+#define MAX_SEGMENT_SIZE ((1ULL << 32) - ALIGNMENT) // offsets are 32 bits
+#define BLOCK_ALLOCATED 0x1
+#define BLOCK_PREV_FREE 0x2
+#define SHARED_MAGIC 0x4D59534841524544ULL // "MYSHARED"
+#define SHARED_VERSION 1
+#define SHARED_READY 0
+#define SHARED_CORRUPT 1
+
+// 8-byte header at the start of every block
+typedef struct Header {
+    uint32_t payload;
+    uint32_t status;
+} Header;
+
+// links stored in the payload of a free block, as offsets from the start of the segment
+typedef struct Links {
+    uint32_t previous;
+    uint32_t next;
+} Links;
+
+// allocator state at the start of the segment
+typedef struct SharedControl {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t state; // SHARED_READY or SHARED_CORRUPT
+    pthread_mutex_t lock; // process-shared and robust
+    uint64_t segment_size;
+    uint32_t first_block;
+    uint32_t free_list_start; // MYSHARED_NULL when the list is empty
+    uint64_t free_bytes; // total size, headers included, of the free blocks
+} SharedControl;
+
+static unsigned char *segment_start; // where this process mapped the segment
+static SharedControl *control;
+
+/* ------------------
+ * UTILITY FUNCTIONS
+ * ------------------
+ */
+
+/*
+Function: get_block
+Input: Unsigned 32-bit offset
+Return Value: Pointer to a Header
+=======================================
+Returns the block at the given offset in this process's mapping.
+*/
+static Header *get_block(uint32_t offset) {
+    return (Header *)(segment_start + offset);
+}
+
+/*
+Function: get_offset
+Input: Pointer to a Header
+Return Value: Unsigned 32-bit offset
+=======================================
+Returns the offset of the block from the start of the segment.
+*/
+static uint32_t get_offset(const Header *block) {
+    return (const unsigned char *)block - segment_start;
+}
+
+/*
+Function: get_links
+Input: Pointer to a Header
+Return Value: Pointer to Links
+=======================================
+Returns the list links stored at the start of a free block's payload.
+*/
+static Links *get_links(Header *block) {
+    return (Links *)((unsigned char *)block + HEADER_SIZE);
+}
+
+/*
+Function: get_right_block
+Input: Pointer to a Header
+Return Value: Pointer to a Header
+=======================================
+Returns the block after the given one, or NULL if the given block is the last in the segment.
+*/
+static Header *get_right_block(Header *block) {
+    unsigned char *right = (unsigned char *)block + HEADER_SIZE + block->payload;
+    return right < segment_start + control->segment_size ? (Header *)right : NULL;
+}
+
+/*
+Function: get_aligned_size
+Input: size_t number
+Return Value: size_t number
+=======================================
+Rounds a request up to ALIGNMENT and to at least MIN_PAYLOAD_SIZE.
+*/
+static size_t get_aligned_size(size_t requested_size) {
+    size_t aligned_size = (requested_size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    return aligned_size < MIN_PAYLOAD_SIZE ? MIN_PAYLOAD_SIZE : aligned_size;
+}
+
+/* ------------------
+ * FREE LIST
+ * ------------------
+ */
+
+/*
+Function: mark_free
+Input: Pointer to a Header and boolean
+Return Value: None
+=======================================
+Writes the block's footer when it is free, and sets or clears the BLOCK_PREV_FREE bit of the block to its right. The block's own
+allocated bit must already be up to date.
+*/
+static void mark_free(Header *block, bool is_free) {
+    if (is_free) {
+        *(uint32_t *)((unsigned char *)block + HEADER_SIZE + block->payload - sizeof(uint32_t)) = block->payload;
+    }
+    Header *right = get_right_block(block);
+    if (right != NULL) {
+        right->status = is_free ? right->status | BLOCK_PREV_FREE : right->status & ~BLOCK_PREV_FREE;
+    }
+}
+
+/*
+Function: add_block
+Input: Pointer to a Header
+Return Value: None
+=======================================
+Pushes the block onto the front of the free list and marks it free.
+*/
+static void add_block(Header *block) {
+    Links *links = get_links(block);
+    links->previous = MYSHARED_NULL;
+    links->next = control->free_list_start;
+    if (control->free_list_start != MYSHARED_NULL) {
+        get_links(get_block(control->free_list_start))->previous = get_offset(block);
+    }
+    control->free_list_start = get_offset(block);
+    control->free_bytes += block->payload + HEADER_SIZE;
+    block->status &= ~BLOCK_ALLOCATED;
+    mark_free(block, true);
+}
+
+/*
+Function: remove_block
+Input: Pointer to a Header
+Return Value: None
+=======================================
+Unlinks the block from the free list. The block's status is left to the caller, so it can be flipped as the last store.
+*/
+static void remove_block(Header *block) {
+    Links *links = get_links(block);
+    if (links->previous != MYSHARED_NULL) {
+        get_links(get_block(links->previous))->next = links->next;
+    } else {
+        control->free_list_start = links->next;
+    }
+    if (links->next != MYSHARED_NULL) {
+        get_links(get_block(links->next))->previous = links->previous;
+    }
+    control->free_bytes -= block->payload + HEADER_SIZE;
+}
+
+/* ------------------
+ * LOCKING AND REPAIR
+ * ------------------
+ */
+
+/*
+Function: repair_heap
+Input: None
+Return Value: Boolean
+=======================================
+Rebuilds the free list, the footers, the boundary tags, and the free byte count from the block headers, merging adjacent free
+blocks on the way. Called with the lock held after its previous owner died. Marks the heap corrupt and returns false if a header
+is impossible.
+*/
+static bool repair_heap(void) {
+    uint64_t offset = control->first_block;
+    while (offset < control->segment_size) { // every header must describe a block that ends inside the segment
+        Header *block = get_block(offset);
+        if (block->payload < MIN_PAYLOAD_SIZE || block->payload % ALIGNMENT != 0 ||
+            offset + HEADER_SIZE + (uint64_t)block->payload > control->segment_size) {
+            control->state = SHARED_CORRUPT;
+            return false;
+        }
+        offset += HEADER_SIZE + block->payload;
+    }
+
+    control->free_list_start = MYSHARED_NULL;
+    control->free_bytes = 0;
+    Header *left = NULL;
+    for (Header *block = get_block(control->first_block); block != NULL;) {
+        Header *right = get_right_block(block);
+        if (!(block->status & BLOCK_ALLOCATED) && left != NULL && !(left->status & BLOCK_ALLOCATED)) {
+            remove_block(left); // re-added below with its new size
+            left->payload += HEADER_SIZE + block->payload;
+            add_block(left);
+        } else {
+            block->status &= BLOCK_ALLOCATED;
+            if (left != NULL && !(left->status & BLOCK_ALLOCATED)) {
+                block->status |= BLOCK_PREV_FREE;
+            }
+            if (!(block->status & BLOCK_ALLOCATED)) {
+                add_block(block);
+            }
+            left = block;
+        }
+        block = right;
+    }
+    return true;
+}
+
+/*
+Function: lock_heap
+Input: None
+Return Value: Boolean
+=======================================
+Takes the heap lock, repairing the heap first if the previous owner died holding it. Returns false, without the lock held, if
+the heap is corrupt or was never attached.
+*/
+static bool lock_heap(void) {
+    if (control == NULL) {
+        return false;
+    }
+    int result = pthread_mutex_lock(&control->lock);
+    if (result == EOWNERDEAD) {
+        if (control->state == SHARED_READY) {
+            repair_heap();
+        }
+        pthread_mutex_consistent(&control->lock);
+    } else if (result != 0) {
+        return false;
+    }
+    if (control->state != SHARED_READY) {
+        pthread_mutex_unlock(&control->lock);
+        return false;
+    }
+    return true;
+}
+
+/* ------------------
+ * MAIN FUNCTIONS
+ * ------------------
+ */
+
+/*
+Function: myshared_init
+Input: Void pointer and size_t number
+Return Value: Boolean
+=======================================
+Formats the segment as a heap with one free block and a robust, process-shared lock, and attaches this process to it. The segment
+must be 8-byte aligned, at most 4GB, and large enough for the control block and one block. No other process may use the segment
+until this returns.
+*/
+bool myshared_init(void *segment, size_t segment_size) {
+    size_t first_block = (sizeof(SharedControl) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    segment_size &= ~(size_t)(ALIGNMENT - 1);
+    if ((uintptr_t)segment % ALIGNMENT != 0 || segment_size > MAX_SEGMENT_SIZE || segment_size < first_block + MIN_BLOCK_SIZE) {
+        return false;
+    }
+    SharedControl *new_control = segment;
+    memset(new_control, 0, sizeof(SharedControl));
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int result = pthread_mutex_init(&new_control->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (result != 0) {
+        return false;
+    }
+
+    segment_start = segment;
+    control = new_control;
+    control->version = SHARED_VERSION;
+    control->state = SHARED_READY;
+    control->segment_size = segment_size;
+    control->first_block = first_block;
+    control->free_list_start = MYSHARED_NULL;
+    control->free_bytes = 0;
+
+    Header *block = get_block(first_block);
+    block->payload = segment_size - first_block - HEADER_SIZE;
+    block->status = 0;
+    add_block(block);
+    __atomic_store_n(&control->magic, SHARED_MAGIC, __ATOMIC_RELEASE); // attach refuses the segment until now
+    return true;
+}
+
+/*
+Function: myshared_attach
+Input: Void pointer
+Return Value: Boolean
+=======================================
+Attaches this process to a segment that myshared_init formatted, possibly in another process and at another address. Returns
+false if the segment does not hold a heap of this version.
+*/
+bool myshared_attach(void *segment) {
+    SharedControl *new_control = segment;
+    if (__atomic_load_n(&new_control->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC || new_control->version != SHARED_VERSION) {
+        return false;
+    }
+    segment_start = segment;
+    control = new_control;
+    return true;
+}
+
+/*
+Function: myshared_malloc
+Input: size_t number
+Return Value: Void pointer
+=======================================
+Returns the payload of the first free block that fits, split if the remainder can hold a block of its own. Returns NULL for a
+request of 0 or more than MAX_REQUEST_SIZE bytes, when no block fits, or when the heap is corrupt.
+*/
+void *myshared_malloc(size_t requested_size) {
+    if (requested_size > MAX_REQUEST_SIZE || requested_size == 0 || !lock_heap()) {
+        return NULL;
+    }
+    size_t payload = get_aligned_size(requested_size);
+
+    Header *block = NULL;
+    for (uint32_t offset = control->free_list_start; offset != MYSHARED_NULL; offset = get_links(get_block(offset))->next) {
+        if (get_block(offset)->payload >= payload) {
+            block = get_block(offset);
+            break;
+        }
+    }
+    if (block == NULL) {
+        pthread_mutex_unlock(&control->lock);
+        return NULL;
+    }
+
+    remove_block(block);
+    if (block->payload >= payload + MIN_BLOCK_SIZE) {
+        // the remainder's header goes in first, so the split is committed by the store that shrinks the block
+        Header *remainder = (Header *)((unsigned char *)block + HEADER_SIZE + payload);
+        remainder->payload = block->payload - payload - HEADER_SIZE;
+        remainder->status = 0;
+        block->payload = payload;
+        add_block(remainder);
+    }
+    block->status |= BLOCK_ALLOCATED;
+    mark_free(block, false);
+    pthread_mutex_unlock(&control->lock);
+    return (unsigned char *)block + HEADER_SIZE;
+}
+
+/*
+Function: myshared_free
+Input: Void pointer
+Return Value: None
+=======================================
+Frees the payload, which any attached process may have allocated, merging it with free neighbors on both sides.
+*/
+void myshared_free(void *ptr) {
+    if (ptr == NULL || !lock_heap()) {
+        return;
+    }
+    Header *block = (Header *)((unsigned char *)ptr - HEADER_SIZE);
+
+    Header *right = get_right_block(block);
+    if (right != NULL && !(right->status & BLOCK_ALLOCATED)) {
+        remove_block(right);
+        block->payload += HEADER_SIZE + right->payload;
+    }
+    if (block->status & BLOCK_PREV_FREE) {
+        uint32_t left_payload = *(uint32_t *)((unsigned char *)block - sizeof(uint32_t));
+        Header *left = (Header *)((unsigned char *)block - HEADER_SIZE - left_payload);
+        remove_block(left);
+        left->payload += HEADER_SIZE + block->payload;
+        block = left;
+    }
+    add_block(block);
+    pthread_mutex_unlock(&control->lock);
+}
+
+/*
+Function: myshared_offset
+Input: Void pointer
+Return Value: size_t number
+=======================================
+Returns the offset of the payload from the start of the segment, or MYSHARED_NULL for NULL.
+*/
+size_t myshared_offset(const void *ptr) {
+    return ptr != NULL ? (size_t)((const unsigned char *)ptr - segment_start) : MYSHARED_NULL;
+}
+
+/*
+Function: myshared_ptr
+Input: size_t number
+Return Value: Void pointer
+=======================================
+Returns the payload at the given offset in this process's mapping, or NULL for MYSHARED_NULL.
+*/
+void *myshared_ptr(size_t offset) {
+    return offset != MYSHARED_NULL ? segment_start + offset : NULL;
+}
+
+/* ------------------
+ * DEBUGGING
+ * ------------------
+ */
+
+/*
+Function: myshared_validate
+Input: None
+Return Value: Boolean
+=======================================
+Walks the blocks and the free list under the lock and checks that the blocks tile the segment, that no two adjacent blocks are
+free, that boundary tags and footers agree with the headers, and that the free list holds exactly the free blocks and bytes.
+Prints the problem and hits a breakpoint on the first failure.
+*/
+bool myshared_validate(void) {
+    if (!lock_heap()) {
+        printf("shared heap is not attached or is corrupt\n");
+        breakpoint();
+        return false;
+    }
+    bool valid = true;
+    size_t free_blocks = 0;
+    uint64_t free_bytes = 0;
+    bool left_free = false;
+    uint64_t offset = control->first_block;
+    while (valid && offset < control->segment_size) {
+        Header *block = get_block(offset);
+        bool is_free = !(block->status & BLOCK_ALLOCATED);
+        if (block->payload < MIN_PAYLOAD_SIZE || block->payload % ALIGNMENT != 0 ||
+            offset + HEADER_SIZE + (uint64_t)block->payload > control->segment_size) {
+            printf("block at offset %lu has an impossible payload of %u\n", (unsigned long)offset, block->payload);
+            valid = false;
+        } else if (left_free != ((block->status & BLOCK_PREV_FREE) != 0) || (left_free && is_free)) {
+            printf("block at offset %lu disagrees with its left neighbor about being free\n", (unsigned long)offset);
+            valid = false;
+        } else if (is_free && *(uint32_t *)((unsigned char *)block + HEADER_SIZE + block->payload - 4) != block->payload) {
+            printf("free block at offset %lu has a footer that does not match its payload\n", (unsigned long)offset);
+            valid = false;
+        }
+        if (is_free) {
+            free_blocks++;
+            free_bytes += HEADER_SIZE + block->payload;
+        }
+        left_free = is_free;
+        offset += HEADER_SIZE + block->payload;
+    }
+
+    size_t listed = 0;
+    for (uint32_t link = control->free_list_start; valid && link != MYSHARED_NULL; link = get_links(get_block(link))->next) {
+        if (get_block(link)->status & BLOCK_ALLOCATED || ++listed > free_blocks) {
+            printf("free list reaches an allocated block or loops at offset %u\n", link);
+            valid = false;
+        }
+    }
+    if (valid && (listed != free_blocks || free_bytes != control->free_bytes)) {
+        printf("free list holds %zu of %zu free blocks, %lu free bytes recorded for %lu\n", listed, free_blocks,
+               (unsigned long)control->free_bytes, (unsigned long)free_bytes);
+        valid = false;
+    }
+    pthread_mutex_unlock(&control->lock);
+    if (!valid) {
+        breakpoint();
+    }
+    return valid;
+}
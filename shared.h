@@ -0,0 +1,44 @@
+/*
+Mondee Lu, cs107, shared.h
+This header declares the shared heap allocator implemented in shared.c, an explicit list allocator whose state lives entirely in the
+segment it manages, so a segment mapped into several processes (with shm_open or memfd_create and mmap MAP_SHARED) can be allocated
+from and freed into by all of them. A typical producer and consumer:
+
+    // creator, before handing the segment to the workers
+    int fd = shm_open("/msgs", O_CREAT | O_RDWR, 0600);
+    ftruncate(fd, size);
+    void *segment = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    myshared_init(segment, size);
+
+    // every other process, after mapping the same object at whatever address mmap picks
+    myshared_attach(segment);
+
+    // producer                                         // consumer
+    void *msg = myshared_malloc(len);                    void *msg = myshared_ptr(offset);
+    fill(msg, len);                                      consume(msg);
+    send(myshared_offset(msg));                          myshared_free(msg);
+*/
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MYSHARED_NULL 0 // offset that no payload has, returned by myshared_offset(NULL)
+
+// formats the segment as an empty heap, the segment must be 8-byte aligned and under 4GB
+bool myshared_init(void *segment, size_t segment_size);
+// uses a segment formatted by myshared_init in this or another process, mapped at any address
+bool myshared_attach(void *segment);
+// returns a payload of at least requested_size bytes from the shared heap, or NULL
+void *myshared_malloc(size_t requested_size);
+// frees a payload allocated by any process attached to the heap
+void myshared_free(void *ptr);
+// offset of a payload from the start of the segment, the same in every process
+size_t myshared_offset(const void *ptr);
+// payload at the given offset in this process's mapping of the segment
+void *myshared_ptr(size_t offset);
+// checks the heap's blocks, boundary tags, and free list
+bool myshared_validate(void);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+Mondee Lu, cs107, sharedcrash.c
+This program tests the crash recovery of the shared heap allocator in shared.c. Worker processes allocate from and free into one
+shared heap as fast as they can and are killed with SIGKILL at arbitrary points, many of them while holding the heap lock, and the
+heap must stay usable and valid after every round.
+
+WORKLOAD: The parent maps a memfd segment, formats it with myshared_init, and then runs rounds. In each round it forks a few workers,
+which attach to the segment at their own address and churn random allocations of 4 to 3000 bytes, filling each with a pattern. After
+a short, varying delay the parent kills all of them. Each worker records the offsets of its live allocations in a second shared
+mapping, writing an offset after the allocation returns and clearing it before the free, so after a kill the parent can free
+whatever the worker left behind without ever freeing an offset twice. A worker killed between an allocation and the store of its
+offset leaks that block, which is the documented cost of a crash.
+
+CHECKS: After every round, myshared_validate must pass, which also forces the repair if a worker died holding the lock, and every
+recorded allocation must still hold its pattern before the parent frees it. At the end the parent must still be able to allocate.
+The exit status is 0 only if every check held.
+
+USAGE: ./sharedcrash [rounds] [workers]
+*/
+#define _GNU_SOURCE
+#include "shared.h"
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SEGMENT_SIZE (4 << 20)
+#define DEFAULT_ROUNDS 60
+#define DEFAULT_WORKERS 4
+#define MAX_WORKERS 16
+#define LIVE_PER_WORKER 64
+#define MAX_PAYLOAD 3000
+
+// offsets of each worker's live allocations, MYSHARED_NULL when a slot is empty
+typedef struct LiveTable {
+    size_t offsets[MAX_WORKERS][LIVE_PER_WORKER];
+} LiveTable;
+
+/*
+Function: fill_payload
+Input: Pointer to a payload and uint32_t number
+Return Value: None
+=====================================================
+Fills the payload with a pattern derived from its size, which is kept in its first 4 bytes.
+*/
+void fill_payload(unsigned char *payload, uint32_t size) {
+    memset(payload, (unsigned char)size, size);
+    memcpy(payload, &size, sizeof(size));
+}
+
+/*
+Function: payload_intact
+Input: Pointer to a payload
+Return Value: Boolean
+=====================================================
+Returns true if a payload written by fill_payload still holds its pattern.
+*/
+bool payload_intact(const unsigned char *payload) {
+    uint32_t size;
+    memcpy(&size, payload, sizeof(size));
+    if (size < sizeof(uint32_t) || size > MAX_PAYLOAD) {
+        return false;
+    }
+    for (uint32_t i = sizeof(size); i < size; i++) {
+        if (payload[i] != (unsigned char)size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Function: run_worker
+Input: Memfd, pointer to the LiveTable, and worker index
+Return Value: None
+=====================================================
+Maps and attaches the heap and churns allocations until killed, recording the offset of every live allocation in its row of the
+live table.
+*/
+void run_worker(int fd, LiveTable *live, size_t index) {
+    void *segment = mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (segment == MAP_FAILED || !myshared_attach(segment)) {
+        _exit(1);
+    }
+    unsigned int seed = getpid();
+    size_t *offsets = live->offsets[index];
+    for (;;) {
+        size_t slot = rand_r(&seed) % LIVE_PER_WORKER;
+        size_t offset = __atomic_load_n(&offsets[slot], __ATOMIC_RELAXED);
+        if (offset != MYSHARED_NULL) {
+            __atomic_store_n(&offsets[slot], MYSHARED_NULL, __ATOMIC_RELAXED); // cleared first, a kill here leaks instead of double freeing
+            myshared_free(myshared_ptr(offset));
+        } else {
+            uint32_t size = sizeof(uint32_t) + rand_r(&seed) % (MAX_PAYLOAD - sizeof(uint32_t) + 1);
+            unsigned char *payload = myshared_malloc(size);
+            if (payload != NULL) {
+                fill_payload(payload, size);
+                __atomic_store_n(&offsets[slot], myshared_offset(payload), __ATOMIC_RELAXED);
+            }
+        }
+    }
+}
+
+/*
+Function: free_leftovers
+Input: Pointer to the LiveTable and number of workers
+Return Value: Boolean
+=====================================================
+Frees every allocation the killed workers recorded and empties the table. Returns false if any of them lost its pattern.
+*/
+bool free_leftovers(LiveTable *live, size_t workers) {
+    bool intact = true;
+    for (size_t w = 0; w < workers; w++) {
+        for (size_t i = 0; i < LIVE_PER_WORKER; i++) {
+            if (live->offsets[w][i] != MYSHARED_NULL) {
+                unsigned char *payload = myshared_ptr(live->offsets[w][i]);
+                intact = intact && payload_intact(payload);
+                myshared_free(payload);
+                live->offsets[w][i] = MYSHARED_NULL;
+            }
+        }
+    }
+    return intact;
+}
+
+int main(int argc, char *argv[]) {
+    size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ROUNDS;
+    size_t workers = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_WORKERS;
+    int fd = memfd_create("sharedcrash", 0);
+    void *segment = fd >= 0 && ftruncate(fd, SEGMENT_SIZE) == 0 ?
+                    mmap(NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    LiveTable *live = mmap(NULL, sizeof(LiveTable), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (workers == 0 || workers > MAX_WORKERS || segment == MAP_FAILED || live == MAP_FAILED ||
+        !myshared_init(segment, SEGMENT_SIZE)) {
+        fprintf(stderr, "usage: %s [rounds] [workers <= %d]\n", argv[0], MAX_WORKERS);
+        return 1;
+    }
+
+    for (size_t round = 0; round < rounds; round++) {
+        pid_t pids[MAX_WORKERS];
+        for (size_t w = 0; w < workers; w++) {
+            pids[w] = fork();
+            if (pids[w] == 0) {
+                run_worker(fd, live, w);
+            }
+        }
+        struct timespec delay = {0, 2000000 + (round % 7) * 300000}; // varies where in an operation the kill lands
+        nanosleep(&delay, NULL);
+        for (size_t w = 0; w < workers; w++) {
+            if (pids[w] > 0) {
+                kill(pids[w], SIGKILL);
+                waitpid(pids[w], NULL, 0);
+            }
+        }
+
+        if (!myshared_validate() || !free_leftovers(live, workers) || !myshared_validate()) {
+            printf("sharedcrash: FAILED in round %zu\n", round);
+            return 1;
+        }
+    }
+
+    void *payload = myshared_malloc(1000);
+    bool ok = payload != NULL;
+    myshared_free(payload);
+    ok = ok && myshared_validate();
+    printf("sharedcrash: %s after %zu rounds of %zu workers\n", ok ? "ok" : "FAILED", rounds, workers);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+/*
+Mondee Lu, cs107, stress.c
+This program stress tests the thread safety of the explicit list heap allocator in explicit.c. Several threads allocate and free
+through every thread-safe entry point at once, handing objects to each other, and the heap must come out of it intact.
+
+WORKLOAD: The threads share a table of object slots. Each operation swaps a random slot with NULL. If the slot held an object, its
+contents are checked and it is freed through myfree, myfree_small, or myfree_async, whichever thread allocated it. Otherwise a new
+object is allocated through mymalloc, mymalloc_small, mymalloc_flags, mymalloc_near, or myrealloc of a fresh object, filled with
+a pattern, and published in the slot. Objects therefore routinely die on a different thread than the one that allocated them, which
+moves small blocks between quick list slots and through the transfer cache, and large blocks between shards.
+
+CHECKS: Every object carries its fill byte and its size (up to 255) in its first two bytes and the fill byte everywhere else, so an
+object handed out twice, or overwritten by the allocator, fails the check when it is freed. With check_per_op set, the incremental
+checker also verifies blocks and free list links on every call and stops at the first corruption it finds. At the end every object
+is freed, the async rings are drained, and the quick lists are flushed, after which every shard must be back to a single free block,
+usage must be 0, and validate_heap_full must find every block, free list, and boundary tag intact. The exit status is 0 only if all
+of this holds.
+
+USAGE: ./stress [threads] [ops_per_thread] [shards] [check_per_op]
+*/
+#include "allocator.h"
+#include "explicit.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_THREADS 64
+#define DEFAULT_THREADS 8
+#define DEFAULT_OPS 100000
+#define DEFAULT_SHARDS 4
+#define NUM_SLOTS 4096
+#define HEAP_SIZE (32 << 20)
+
+static unsigned char heap[HEAP_SIZE] __attribute__((aligned(64)));
+static unsigned char *slots[NUM_SLOTS];
+static size_t ops_per_thread;
+static int bad_objects;
+
+/*
+Function: fill_object
+Input: Pointer to an object, size_t number, and fill byte
+Return Value: None
+=====================================================
+Writes the fill byte over the object, then its fill byte and size (capped at 255) into the first two bytes.
+*/
+void fill_object(unsigned char *object, size_t size, unsigned char fill) {
+    memset(object, fill, size);
+    object[0] = fill;
+    object[1] = size > 255 ? 255 : size;
+}
+
+/*
+Function: object_intact
+Input: Pointer to an object
+Return Value: Boolean
+=====================================================
+Returns true if every byte of the object after the first two, as far as its recorded size, still holds its fill byte.
+*/
+bool object_intact(const unsigned char *object) {
+    for (size_t i = 2; i < object[1]; i++) {
+        if (object[i] != object[0]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+Function: allocate_object
+Input: size_t number and pointer to the seed
+Return Value: Pointer to an object
+=====================================================
+Allocates an object of the given size through a randomly chosen entry point.
+*/
+unsigned char *allocate_object(size_t size, unsigned int *seed) {
+    switch (rand_r(seed) % 6) {
+    case 0:
+        return mymalloc(size);
+    case 1:
+        return mymalloc_flags(size, 1u << (rand_r(seed) % 4)); // one of the lifetime and temperature hints
+    case 2:
+        return mymalloc_near(__atomic_load_n(&slots[rand_r(seed) % NUM_SLOTS], __ATOMIC_RELAXED), size); // only an address
+    case 3: {
+        unsigned char *object = mymalloc(size / 2 + 2);
+        unsigned char *grown = object != NULL ? myrealloc(object, size) : NULL;
+        if (grown == NULL) {
+            myfree(object);
+        }
+        return grown;
+    }
+    default:
+        return mymalloc_small(size);
+    }
+}
+
+/*
+Function: free_object
+Input: Pointer to an object and pointer to the seed
+Return Value: None
+=====================================================
+Frees the object through a randomly chosen entry point.
+*/
+void free_object(unsigned char *object, unsigned int *seed) {
+    switch (rand_r(seed) % 4) {
+    case 0:
+        myfree(object);
+        break;
+    case 1:
+        myfree_async(object);
+        break;
+    default:
+        myfree_small(object);
+        break;
+    }
+}
+
+/*
+Function: run_worker
+Input: Void pointer holding the thread's seed
+Return Value: Void pointer
+=====================================================
+Runs ops_per_thread operations on random slots, as described in the WORKLOAD section.
+*/
+void *run_worker(void *arg) {
+    unsigned int seed = (unsigned int)(size_t)arg;
+    for (size_t op = 0; op < ops_per_thread; op++) {
+        unsigned char **slot = &slots[rand_r(&seed) % NUM_SLOTS];
+        unsigned char *object = __atomic_exchange_n(slot, NULL, __ATOMIC_ACQ_REL);
+        if (object != NULL) {
+            if (!object_intact(object)) {
+                __atomic_store_n(&bad_objects, 1, __ATOMIC_RELAXED);
+            }
+            free_object(object, &seed);
+            continue;
+        }
+
+        size_t size = 2 + rand_r(&seed) % (rand_r(&seed) % 10 != 0 ? QUICK_MAX_PAYLOAD - 1 : 4000);
+        object = allocate_object(size, &seed);
+        if (object == NULL) {
+            continue;
+        }
+        fill_object(object, size, rand_r(&seed));
+        unsigned char *displaced = __atomic_exchange_n(slot, object, __ATOMIC_ACQ_REL);
+        if (displaced != NULL) { // another thread filled the slot in the meantime
+            myfree(displaced);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    size_t threads = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_THREADS;
+    ops_per_thread = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_OPS;
+    MyHeapOptions opts = {0};
+    opts.num_shards = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_SHARDS;
+    opts.check_per_op = argc > 4 ? strtoul(argv[4], NULL, 10) : 0;
+    if (threads == 0 || threads > MAX_THREADS || !myinit_opts(heap, HEAP_SIZE, &opts)) {
+        fprintf(stderr, "usage: %s [threads <= %d] [ops_per_thread] [shards] [check_per_op]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    pthread_t tids[MAX_THREADS];
+    for (size_t i = 0; i < threads; i++) {
+        pthread_create(&tids[i], NULL, run_worker, (void *)(i * 7919 + 1));
+    }
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    myheap_drain_async();
+    for (size_t i = 0; i < NUM_SLOTS; i++) {
+        if (slots[i] != NULL) {
+            bad_objects |= !object_intact(slots[i]);
+            myfree(slots[i]);
+        }
+    }
+    myheap_drain_async();
+    myheap_quick_flush();
+
+    MyHeapStats stats;
+    myheap_stats(&stats);
+    bool valid = validate_heap_full();
+    bool ok = !bad_objects && stats.usage == 0 && stats.free_blocks == (opts.num_shards > 1 ? opts.num_shards : 1) && valid;
+    printf("stress: %s (bad objects %d, usage %zu, free blocks %zu, heap %s)\n", ok ? "ok" : "FAILED", bad_objects, stats.usage,
+           stats.free_blocks, valid ? "valid" : "INVALID");
+    return ok ? 0 : 1;
+}
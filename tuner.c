@@ -0,0 +1,526 @@
+/*
+Mondee Lu, cs107, tuner.c
+This program picks a configuration for the explicit list heap allocator from recorded allocation traces. It replays each trace
+against a model of explicit.c for every candidate configuration, scores the configurations, and writes the best one as a
+myheap_config.h that explicit.h includes when it is on the include path.
+
+TRACES: A trace has one request per line, in the format of the cs107 test scripts: "a id size" allocates, "f id" frees, and
+"r id size" reallocates the block allocated under id. Any other line (such as a script header) is skipped.
+
+MODEL: The model follows explicit.c block for block but never touches payload memory: blocks are records holding an offset, a
+payload size, and their address and free list neighbors. It reproduces the 8-byte header, the 16-byte minimum payload, LIFO insertion,
+splitting with the candidate threshold (merging the remainder with a free right neighbor), coalescing in both directions on free,
+in-place growth into a free right neighbor on realloc, and the candidate fit policy. When a candidate enables the quick lists, every
+payload of at most QUICK_MAX_PAYLOAD is cached by size on free and reused on malloc at the cost of a single step, as if the program
+called mymalloc_small and myfree_small. Shards, refill batches, and threads are not modeled.
+
+COST: For each trace the model records the peak of the live requested bytes, the peak extent of the heap (the end of the highest
+block ever allocated), and the number of blocks examined per request, one step per free list candidate or quick list pop. A
+configuration costs
+
+    frag_weight * (1 - peak live / peak extent) + step_weight * steps per request
+
+averaged over the traces, and a request that cannot be placed in the modeled segment makes the configuration ineligible.
+
+USAGE: ./tuner [-f frag_weight] [-s step_weight] [-o myheap_config.h] trace...
+*/
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 8 // as in explicit.c
+#define MIN_PAYLOAD_SIZE 16
+#define MIN_BLOCK_SIZE 24
+#define ALIGNMENT 8
+#define SEGMENT_SIZE (1UL << 32) // modeled segment, large enough that only a runaway trace runs out
+#define NONE ((size_t)-1)
+#define FIT_FIRST 0
+#define FIT_BEST 1
+
+static const size_t split_thresholds[] = {24, 32, 48, 64, 128, 256};
+static const int fit_policies[] = {FIT_FIRST, FIT_BEST};
+static const size_t quick_max_payloads[] = {0, 64, 128, 256}; // 0 leaves the quick lists out of the model
+
+// one request of a trace
+typedef struct Request {
+    char op;
+    size_t id;
+    size_t size;
+} Request;
+
+typedef struct Trace {
+    const char *name;
+    Request *requests;
+    size_t num_requests;
+    size_t num_ids;
+} Trace;
+
+// a candidate configuration and its score
+typedef struct Config {
+    size_t split_threshold;
+    int fit_policy;
+    size_t quick_max_payload;
+    double utilization; // averaged over the traces
+    double steps; // per request, averaged over the traces
+    double cost;
+    bool failed;
+} Config;
+
+// the model's record of one block
+typedef struct Block {
+    size_t offset;
+    size_t payload;
+    bool free;
+    size_t prev_addr, next_addr; // neighbors in address order, NONE at either end
+    size_t prev_free, next_free; // neighbors on the free list, or on the block's quick list while it is cached
+} Block;
+
+// the modeled heap for one replay
+typedef struct Model {
+    const Config *config;
+    Block *blocks;
+    size_t num_blocks, capacity;
+    size_t unused; // stack of recycled records, linked through next_free
+    size_t free_list_start;
+    size_t *quick_lists; // one stack per 8-byte class, linked through next_free
+    size_t steps;
+    size_t extent;
+} Model;
+
+/* ------------------
+ * MODEL
+ * ------------------
+ */
+
+/*
+Function: new_block
+Input: Pointer to a Model, size_t offset, and size_t payload
+Return Value: size_t block index
+=====================================================
+Returns a fresh allocated record with the given offset and payload, recycling a merged record when there is one.
+*/
+size_t new_block(Model *model, size_t offset, size_t payload) {
+    size_t index = model->unused;
+    if (index != NONE) {
+        model->unused = model->blocks[index].next_free;
+    } else {
+        if (model->num_blocks == model->capacity) {
+            model->capacity = model->capacity > 0 ? model->capacity * 2 : 1024;
+            model->blocks = realloc(model->blocks, model->capacity * sizeof(Block));
+            if (model->blocks == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        index = model->num_blocks++;
+    }
+    model->blocks[index] = (Block){offset, payload, false, NONE, NONE, NONE, NONE};
+    return index;
+}
+
+/*
+Function: add_block
+Input: Pointer to a Model and size_t block index
+Return Value: None
+=====================================================
+Marks the block free and pushes it onto the front of the free list, as explicit.c's add_block does.
+*/
+void add_block(Model *model, size_t index) {
+    Block *block = &model->blocks[index];
+    block->free = true;
+    block->prev_free = NONE;
+    block->next_free = model->free_list_start;
+    if (model->free_list_start != NONE) {
+        model->blocks[model->free_list_start].prev_free = index;
+    }
+    model->free_list_start = index;
+}
+
+/*
+Function: remove_block
+Input: Pointer to a Model and size_t block index
+Return Value: None
+=====================================================
+Unlinks the block from the free list and marks it allocated.
+*/
+void remove_block(Model *model, size_t index) {
+    Block *block = &model->blocks[index];
+    if (block->prev_free != NONE) {
+        model->blocks[block->prev_free].next_free = block->next_free;
+    } else {
+        model->free_list_start = block->next_free;
+    }
+    if (block->next_free != NONE) {
+        model->blocks[block->next_free].prev_free = block->prev_free;
+    }
+    block->free = false;
+}
+
+/*
+Function: absorb_right
+Input: Pointer to a Model and size_t block index
+Return Value: None
+=====================================================
+Merges the block's right neighbor, which must be free, into the block and recycles the neighbor's record.
+*/
+void absorb_right(Model *model, size_t index) {
+    Block *block = &model->blocks[index];
+    size_t right = block->next_addr;
+    remove_block(model, right);
+    block->payload += model->blocks[right].payload + HEADER_SIZE;
+    block->next_addr = model->blocks[right].next_addr;
+    if (block->next_addr != NONE) {
+        model->blocks[block->next_addr].prev_addr = index;
+    }
+    model->blocks[right].next_free = model->unused;
+    model->unused = right;
+}
+
+/*
+Function: is_free
+Input: Pointer to a Model and size_t block index
+Return Value: Boolean
+=====================================================
+Returns true if the index names a block that is on the free list.
+*/
+bool is_free(const Model *model, size_t index) {
+    return index != NONE && model->blocks[index].free;
+}
+
+/*
+Function: split
+Input: Pointer to a Model, size_t block index, and size_t payload
+Return Value: None
+=====================================================
+Splits off everything past the given payload when the remainder reaches the split threshold, as explicit.c's partition does:
+the remainder is merged with a free right neighbor and goes onto the free list.
+*/
+void split(Model *model, size_t index, size_t payload) {
+    if (model->blocks[index].payload < payload + model->config->split_threshold) {
+        return;
+    }
+    Block *block = &model->blocks[index];
+    size_t remainder = new_block(model, block->offset + HEADER_SIZE + payload, block->payload - payload - HEADER_SIZE);
+    block = &model->blocks[index]; // new_block may have moved the records
+    block->payload = payload;
+    model->blocks[remainder].prev_addr = index;
+    model->blocks[remainder].next_addr = block->next_addr;
+    if (block->next_addr != NONE) {
+        model->blocks[block->next_addr].prev_addr = remainder;
+    }
+    block->next_addr = remainder;
+    if (is_free(model, model->blocks[remainder].next_addr)) {
+        absorb_right(model, remainder);
+    }
+    add_block(model, remainder);
+}
+
+/*
+Function: model_malloc
+Input: Pointer to a Model and size_t number
+Return Value: size_t block index
+=====================================================
+Serves an aligned payload size from the quick lists or the free list, counting a step per block examined. Returns NONE if no
+free block is large enough.
+*/
+size_t model_malloc(Model *model, size_t payload) {
+    if (payload <= model->config->quick_max_payload && model->quick_lists[payload / ALIGNMENT] != NONE) {
+        size_t index = model->quick_lists[payload / ALIGNMENT];
+        model->quick_lists[payload / ALIGNMENT] = model->blocks[index].next_free;
+        model->steps++;
+        return index;
+    }
+
+    size_t best = NONE;
+    for (size_t curr = model->free_list_start; curr != NONE; curr = model->blocks[curr].next_free) {
+        model->steps++;
+        size_t curr_payload = model->blocks[curr].payload;
+        if (curr_payload >= payload && (best == NONE || curr_payload < model->blocks[best].payload)) {
+            best = curr;
+            if (model->config->fit_policy == FIT_FIRST || curr_payload == payload) {
+                break;
+            }
+        }
+    }
+    if (best == NONE) {
+        return NONE;
+    }
+    split(model, best, payload);
+    remove_block(model, best);
+    size_t end = model->blocks[best].offset + HEADER_SIZE + model->blocks[best].payload;
+    if (end > model->extent) {
+        model->extent = end;
+    }
+    return best;
+}
+
+/*
+Function: model_free
+Input: Pointer to a Model and size_t block index
+Return Value: None
+=====================================================
+Caches the block on its quick list when it is small enough, and otherwise coalesces it with its free neighbors and returns it to
+the free list, as explicit.c's free_block does.
+*/
+void model_free(Model *model, size_t index) {
+    size_t payload = model->blocks[index].payload;
+    if (payload <= model->config->quick_max_payload) {
+        model->blocks[index].next_free = model->quick_lists[payload / ALIGNMENT];
+        model->quick_lists[payload / ALIGNMENT] = index;
+        return;
+    }
+    if (is_free(model, model->blocks[index].next_addr)) {
+        absorb_right(model, index);
+    }
+    size_t left = model->blocks[index].prev_addr;
+    if (is_free(model, left)) { // the left block absorbs this one and moves to the front of the free list
+        Block *block = &model->blocks[index];
+        remove_block(model, left);
+        model->blocks[left].payload += block->payload + HEADER_SIZE;
+        model->blocks[left].next_addr = block->next_addr;
+        if (block->next_addr != NONE) {
+            model->blocks[block->next_addr].prev_addr = left;
+        }
+        block->next_free = model->unused;
+        model->unused = index;
+        index = left;
+    }
+    add_block(model, index);
+}
+
+/*
+Function: model_realloc
+Input: Pointer to a Model, size_t block index, and size_t number
+Return Value: size_t block index
+=====================================================
+Resizes in place when the block, grown into a free right neighbor if it needs more room, is large enough, splitting off any
+excess. Otherwise moves the block, as explicit.c's resize_in_place and myrealloc do. Returns NONE, leaving the old block allocated, if it cannot be moved.
+*/
+size_t model_realloc(Model *model, size_t index, size_t payload) {
+    if (payload > model->blocks[index].payload && is_free(model, model->blocks[index].next_addr)) {
+        absorb_right(model, index);
+    }
+    if (model->blocks[index].payload >= payload) {
+        split(model, index, payload);
+        size_t end = model->blocks[index].offset + HEADER_SIZE + model->blocks[index].payload;
+        if (end > model->extent) {
+            model->extent = end;
+        }
+        return index;
+    }
+    size_t moved = model_malloc(model, payload);
+    if (moved != NONE) {
+        model_free(model, index);
+    }
+    return moved;
+}
+
+/*
+Function: replay
+Input: Pointer to a Trace, pointer to a Config, and pointers to the utilization and steps results
+Return Value: Boolean
+=====================================================
+Replays the trace against a fresh model of the configuration. Returns false if a request could not be placed.
+*/
+bool replay(const Trace *trace, const Config *config, double *utilization, double *steps) {
+    Model model = {config, NULL, 0, 0, NONE, NONE, NULL, 0, 0};
+    size_t num_classes = config->quick_max_payload / ALIGNMENT + 1;
+    model.quick_lists = malloc(num_classes * sizeof(size_t));
+    size_t *ids = malloc(trace->num_ids * sizeof(size_t));
+    size_t *sizes = calloc(trace->num_ids, sizeof(size_t));
+    if (model.quick_lists == NULL || ids == NULL || sizes == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < num_classes; i++) {
+        model.quick_lists[i] = NONE;
+    }
+    for (size_t i = 0; i < trace->num_ids; i++) {
+        ids[i] = NONE;
+    }
+    add_block(&model, new_block(&model, 0, SEGMENT_SIZE - HEADER_SIZE));
+
+    size_t live = 0, peak_live = 0;
+    bool ok = true;
+    for (size_t i = 0; i < trace->num_requests && ok; i++) {
+        const Request *request = &trace->requests[i];
+        size_t payload = (request->size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        payload = payload < MIN_PAYLOAD_SIZE ? MIN_PAYLOAD_SIZE : payload;
+        if (request->op == 'a') {
+            ids[request->id] = model_malloc(&model, payload);
+            ok = ids[request->id] != NONE;
+            live += request->size;
+            sizes[request->id] = request->size;
+        } else if (request->op == 'r' && ids[request->id] != NONE) {
+            ids[request->id] = model_realloc(&model, ids[request->id], payload);
+            ok = ids[request->id] != NONE;
+            live += request->size - sizes[request->id];
+            sizes[request->id] = request->size;
+        } else if (request->op == 'f' && ids[request->id] != NONE) {
+            model_free(&model, ids[request->id]);
+            ids[request->id] = NONE;
+            live -= sizes[request->id];
+        }
+        if (live > peak_live) {
+            peak_live = live;
+        }
+    }
+
+    *utilization = model.extent > 0 ? (double)peak_live / model.extent : 1.0;
+    *steps = trace->num_requests > 0 ? (double)model.steps / trace->num_requests : 0.0;
+    free(model.blocks);
+    free(model.quick_lists);
+    free(ids);
+    free(sizes);
+    return ok;
+}
+
+/* ------------------
+ * TRACES
+ * ------------------
+ */
+
+/*
+Function: read_trace
+Input: String path and pointer to a Trace
+Return Value: Boolean
+=====================================================
+Reads every request line of the file into the trace, renumbering nothing: ids are used as indexes, so num_ids is one more than
+the largest id. Returns false if the file cannot be opened.
+*/
+bool read_trace(const char *path, Trace *trace) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    size_t capacity = 0;
+    char line[256];
+    *trace = (Trace){path, NULL, 0, 0};
+    while (fgets(line, sizeof(line), file) != NULL) {
+        Request request = {0, 0, 0};
+        int fields = sscanf(line, " %c %zu %zu", &request.op, &request.id, &request.size);
+        bool valid = (request.op == 'f' && fields >= 2) || ((request.op == 'a' || request.op == 'r') && fields == 3);
+        if (!valid) {
+            continue;
+        }
+        if (trace->num_requests == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            trace->requests = realloc(trace->requests, capacity * sizeof(Request));
+            if (trace->requests == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+        }
+        trace->requests[trace->num_requests++] = request;
+        if (request.id >= trace->num_ids) {
+            trace->num_ids = request.id + 1;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/* ------------------
+ * MAIN
+ * ------------------
+ */
+
+/*
+Function: write_config
+Input: Pointer to the output file, pointer to the best Config, and the trace names
+Return Value: None
+=====================================================
+Writes the configuration as a header of the macros explicit.h and explicit.c let it override.
+*/
+void write_config(FILE *out, const Config *best, char *trace_names[], int num_traces) {
+    fprintf(out, "/*\nmyheap_config.h, written by tuner from:\n");
+    for (int i = 0; i < num_traces; i++) {
+        fprintf(out, "    %s\n", trace_names[i]);
+    }
+    fprintf(out, "Modeled utilization %.1f%%, %.2f blocks examined per request.\n", best->utilization * 100, best->steps);
+    if (best->quick_max_payload == 0) {
+        fprintf(out, "The quick lists did not pay off on these traces, so call mymalloc and myfree rather than the _small variants.\n");
+    }
+    fprintf(out, "*/\n#ifndef MYHEAP_CONFIG_H\n#define MYHEAP_CONFIG_H\n\n");
+    fprintf(out, "#define MYHEAP_FIT_POLICY %s\n", best->fit_policy == FIT_BEST ? "MYHEAP_FIT_BEST" : "MYHEAP_FIT_FIRST");
+    fprintf(out, "#define SPLIT_THRESHOLD %zu\n", best->split_threshold);
+    if (best->quick_max_payload > 0) {
+        fprintf(out, "#define QUICK_MAX_PAYLOAD %zu\n", best->quick_max_payload);
+    }
+    fprintf(out, "\n#endif\n");
+}
+
+int main(int argc, char *argv[]) {
+    double frag_weight = 1.0;
+    double step_weight = 0.01;
+    const char *out_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:s:o:")) != -1) {
+        if (opt == 'f') {
+            frag_weight = atof(optarg);
+        } else if (opt == 's') {
+            step_weight = atof(optarg);
+        } else if (opt == 'o') {
+            out_path = optarg;
+        } else {
+            optind = argc + 1;
+        }
+    }
+    int num_traces = argc - optind;
+    if (num_traces <= 0) {
+        fprintf(stderr, "usage: %s [-f frag_weight] [-s step_weight] [-o myheap_config.h] trace...\n", argv[0]);
+        return 1;
+    }
+
+    Trace *traces = calloc(num_traces, sizeof(Trace));
+    for (int i = 0; i < num_traces; i++) {
+        if (traces == NULL || !read_trace(argv[optind + i], &traces[i])) {
+            fprintf(stderr, "cannot read %s\n", argv[optind + i]);
+            return 1;
+        }
+    }
+
+    Config best = {0, 0, 0, 0, 0, 0, true};
+    fprintf(stderr, "%-6s %-6s %-6s %12s %12s %10s\n", "split", "fit", "quick", "utilization", "steps/req", "cost");
+    for (size_t s = 0; s < sizeof(split_thresholds) / sizeof(split_thresholds[0]); s++) {
+        for (size_t f = 0; f < sizeof(fit_policies) / sizeof(fit_policies[0]); f++) {
+            for (size_t q = 0; q < sizeof(quick_max_payloads) / sizeof(quick_max_payloads[0]); q++) {
+                Config config = {split_thresholds[s], fit_policies[f], quick_max_payloads[q], 0, 0, 0, false};
+                for (int t = 0; t < num_traces; t++) {
+                    double utilization, steps;
+                    config.failed = config.failed || !replay(&traces[t], &config, &utilization, &steps);
+                    config.utilization += utilization / num_traces;
+                    config.steps += steps / num_traces;
+                }
+                config.cost = frag_weight * (1 - config.utilization) + step_weight * config.steps;
+                fprintf(stderr, "%-6zu %-6s %-6zu %11.1f%% %12.2f %10.4f%s\n", config.split_threshold,
+                        config.fit_policy == FIT_BEST ? "best" : "first", config.quick_max_payload,
+                        config.utilization * 100, config.steps, config.cost, config.failed ? " (failed)" : "");
+                if (!config.failed && (best.failed || config.cost < best.cost)) {
+                    best = config;
+                }
+            }
+        }
+    }
+    if (best.failed) {
+        fprintf(stderr, "no configuration could replay every trace\n");
+        return 1;
+    }
+
+    FILE *out = out_path != NULL ? fopen(out_path, "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "cannot write %s\n", out_path);
+        return 1;
+    }
+    write_config(out, &best, argv + optind, num_traces);
+    if (out != stdout) {
+        fclose(out);
+    }
+    for (int i = 0; i < num_traces; i++) {
+        free(traces[i].requests);
+    }
+    free(traces);
+    return 0;
+}